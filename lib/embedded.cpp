@@ -0,0 +1,223 @@
+#include <scnr/parse_archive.hpp>
+#include <scnr/scnr.hpp>
+#include <scnr/types.hpp>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <optional>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+  #define SCNR_SIMD_SSE2
+  #include <emmintrin.h>
+#elif (defined(__aarch64__) && defined(__ARM_NEON) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || defined(_M_ARM64)
+  #define SCNR_SIMD_NEON
+  #include <arm_neon.h>
+#endif
+
+namespace {
+
+// Magic number of a format detect_content knows
+struct Signature {
+  std::string_view magic;
+  // position of the magic in the payload
+  size_t offset = 0;
+  // for formats whose magic repeats once per member: the bytes the payload takes, hits inside them are members
+  std::optional<std::uint64_t> (*size)(scnr::StreamData stream) = nullptr;
+  // for formats found from the end of the stream: where the payload begins in the file, hits elsewhere are
+  // members or lead to the same end records. Looked up once per file
+  std::optional<std::uint64_t> (*locate)(scnr::StreamData stream) = nullptr;
+};
+
+constexpr Signature kSignatures[] = {
+  {.magic = "\x7f" "ELF"},
+  {.magic = "MZ"},
+  {.magic = "\xfe\xed\xfa\xce"},
+  {.magic = "\xfe\xed\xfa\xcf"},
+  {.magic = "\xce\xfa\xed\xfe"},
+  {.magic = "\xcf\xfa\xed\xfe"},
+  // fat Mach-O and Java class
+  {.magic = "\xca\xfe\xba\xbe"},
+  {.magic = "PK\3\4", .locate = scnr::zip_offset},
+  {.magic = "\x1f\x8b\x08"},
+  {.magic = {"\xfd" "7zXZ\0", 6}},
+  {.magic = "\x28\xb5\x2f\xfd"},
+  {.magic = "!<arch>\n"},
+  {.magic = "ustar", .offset = 257, .size = scnr::tar_size},
+  {.magic = {"\0asm", 4}},
+  {.magic = "dex\n"},
+  {.magic = "BC\xc0\xde"},
+  {.magic = "\xde\xc0\x17\x0b"},
+};
+
+// Magic numbers are found by their first two bytes, the anchor
+using Anchor = std::array<scnr::Byte, 2>;
+
+constexpr Anchor anchor_of(const Signature& signature) {
+  return {static_cast<scnr::Byte>(signature.magic[0]), static_cast<scnr::Byte>(signature.magic[1])};
+}
+
+constexpr size_t kAnchorCount = [] {
+  size_t count = 0;
+  for (size_t i = 0; i < std::size(kSignatures); ++i) {
+    count += std::none_of(kSignatures, kSignatures + i, [&](const Signature& other) {
+      return anchor_of(other) == anchor_of(kSignatures[i]);
+    });
+  }
+  return count;
+}();
+
+constexpr std::array<Anchor, kAnchorCount> kAnchors = [] {
+  std::array<Anchor, kAnchorCount> retval{};
+  size_t count = 0;
+  for (const auto& signature : kSignatures) {
+    if (std::find(retval.begin(), retval.begin() + count, anchor_of(signature)) == retval.begin() + count) {
+      retval[count++] = anchor_of(signature);
+    }
+  }
+  return retval;
+}();
+
+// Bit per pair of bytes, set for the anchors
+constexpr std::array<std::uint64_t, 1024> kAnchorBits = [] {
+  std::array<std::uint64_t, 1024> retval{};
+  for (const auto& anchor : kAnchors) {
+    const size_t pair = anchor[0] << 8 | anchor[1];
+    retval[pair / 64] |= std::uint64_t{1} << (pair % 64);
+  }
+  return retval;
+}();
+
+constexpr size_t kMaxMagic = std::max_element(std::begin(kSignatures), std::end(kSignatures),
+                                              [](const Signature& lhs, const Signature& rhs) {
+                                                return lhs.magic.size() < rhs.magic.size();
+                                              })->magic.size();
+
+// The file is read in chunks that overlap by the longest magic
+constexpr size_t kChunkSize = 1024 * 1024;
+// A file full of short magic numbers, e.g. "MZ", is not detected forever
+constexpr size_t kMaxEmbedded = 1024;
+
+// Calls found(i) for every i < end where an anchor starts, in order; size bytes are readable
+template <typename Found>
+void for_each_anchor(const scnr::Byte* data, size_t end, size_t size, Found&& found) {
+  size_t i = 0;
+#if defined(SCNR_SIMD_SSE2) || defined(SCNR_SIMD_NEON)
+  // every anchor is compared at all positions of a block, the second byte from a load one byte further
+  constexpr size_t kBlock = 16;
+  #if defined(SCNR_SIMD_SSE2)
+  __m128i firsts[kAnchorCount], seconds[kAnchorCount];
+  for (size_t a = 0; a < kAnchorCount; ++a) {
+    firsts[a] = _mm_set1_epi8(static_cast<char>(kAnchors[a][0]));
+    seconds[a] = _mm_set1_epi8(static_cast<char>(kAnchors[a][1]));
+  }
+  for (; i < end && i + kBlock + 1 <= size; i += kBlock) {
+    const __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    const __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 1));
+    __m128i hits = _mm_setzero_si128();
+    for (size_t a = 0; a < kAnchorCount; ++a) {
+      hits = _mm_or_si128(hits, _mm_and_si128(_mm_cmpeq_epi8(first, firsts[a]), _mm_cmpeq_epi8(second, seconds[a])));
+    }
+    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hits));
+  #else
+  uint8x16_t firsts[kAnchorCount], seconds[kAnchorCount];
+  for (size_t a = 0; a < kAnchorCount; ++a) {
+    firsts[a] = vdupq_n_u8(kAnchors[a][0]);
+    seconds[a] = vdupq_n_u8(kAnchors[a][1]);
+  }
+  for (; i < end && i + kBlock + 1 <= size; i += kBlock) {
+    const uint8x16_t first = vld1q_u8(data + i);
+    const uint8x16_t second = vld1q_u8(data + i + 1);
+    uint8x16_t hits = vdupq_n_u8(0);
+    for (size_t a = 0; a < kAnchorCount; ++a) {
+      hits = vorrq_u8(hits, vandq_u8(vceqq_u8(first, firsts[a]), vceqq_u8(second, seconds[a])));
+    }
+    // no movemask in NEON, the rare blocks with a hit are looked at byte by byte
+    unsigned mask = 0;
+    if (vmaxvq_u8(hits) != 0) {
+      alignas(16) scnr::Byte lanes[kBlock];
+      vst1q_u8(lanes, hits);
+      for (size_t lane = 0; lane < kBlock; ++lane) {
+        mask |= (lanes[lane] & 1u) << lane;
+      }
+    }
+  #endif
+    if (end - i < kBlock) {
+      mask &= (1u << (end - i)) - 1;
+    }
+    for (; mask != 0; mask &= mask - 1) {
+      found(i + std::countr_zero(mask));
+    }
+  }
+#endif
+  for (; i < end && i + 1 < size; ++i) {
+    const size_t pair = data[i] << 8 | data[i + 1];
+    if (kAnchorBits[pair / 64] >> (pair % 64) & 1) {
+      found(i);
+    }
+  }
+}
+
+}  // namespace
+
+namespace scnr {
+
+std::vector<EmbeddedFile> find_embedded(scnr::StreamData stream, const ContainerOptions& options,
+                                        const MemberSink& sink) {
+  std::vector<EmbeddedFile> retval;
+  // hits of a signature before that offset are members of its last payload
+  std::array<std::uint64_t, std::size(kSignatures)> members_end{};
+  std::array<bool, std::size(kSignatures)> located{};
+  std::array<std::optional<std::uint64_t>, std::size(kSignatures)> begins{};
+  std::vector<Byte> chunk(kChunkSize + kMaxMagic - 1);
+  for (size_t pos = 0; retval.size() < kMaxEmbedded; pos += kChunkSize) {
+    stream.poll();
+    const size_t nbytes = stream.readsome(chunk.data(), pos, chunk.size());
+    for_each_anchor(chunk.data(), std::min(nbytes, kChunkSize), nbytes, [&](size_t i) {
+      for (size_t s = 0; s < std::size(kSignatures) && retval.size() < kMaxEmbedded; ++s) {
+        const Signature& signature = kSignatures[s];
+        if (nbytes - i < signature.magic.size() ||
+            std::memcmp(chunk.data() + i, signature.magic.data(), signature.magic.size()) != 0 ||
+            pos + i < signature.offset || pos + i - signature.offset < members_end[s]) {
+          continue;
+        }
+        const size_t start = pos + i - signature.offset;
+        auto payload_end = [&] {
+          return signature.size ? start + signature.size(stream.advanced(start)).value_or(0) : 0;
+        };
+        // the file itself, it owns the member headers too
+        if (start == 0) {
+          members_end[s] = payload_end();
+          continue;
+        }
+        if (signature.locate) {
+          if (!located[s]) {
+            begins[s] = signature.locate(stream);
+            located[s] = true;
+          }
+          if (begins[s] != start) {
+            continue;
+          }
+        }
+        // a hit costs the headers of its format, not a read of the rest of the file
+        auto info = detect_magic(stream.advanced(start), options, sink);
+        if (!std::holds_alternative<std::monostate>(info)) {
+          members_end[s] = payload_end();
+          retval.push_back(EmbeddedFile{.offset = start, .info = std::move(info)});
+        }
+      }
+    });
+    if (nbytes < chunk.size()) {
+      break;
+    }
+  }
+  return retval;
+}
+
+}  // namespace scnr
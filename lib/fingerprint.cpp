@@ -0,0 +1,69 @@
+#include <scnr/fingerprint.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+constexpr std::uint64_t kPrime1 = 0x9e3779b185ebca87ULL;
+constexpr std::uint64_t kPrime2 = 0xc2b2ae3d27d4eb4fULL;
+
+// murmur3 finalizer
+std::uint64_t Mix(std::uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+std::uint64_t Load64(const scnr::Byte* data) {
+  std::uint64_t word;
+  std::memcpy(&word, data, sizeof(word));
+  // hashes must not depend on the host byte order
+  return scnr::LEToHost(word);
+}
+
+}  // namespace
+
+namespace scnr {
+
+std::uint64_t hash_bytes(const Byte* data, size_t size, std::uint64_t seed) {
+  // two independent lanes keep both multipliers busy
+  std::uint64_t h1 = seed ^ kPrime1;
+  std::uint64_t h2 = seed ^ kPrime2;
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    h1 = std::rotl(h1 ^ (Load64(data + i) * kPrime2), 31) * kPrime1;
+    h2 = std::rotl(h2 ^ (Load64(data + i + 8) * kPrime2), 31) * kPrime1;
+  }
+  if (i + 8 <= size) {
+    h1 = std::rotl(h1 ^ (Load64(data + i) * kPrime2), 31) * kPrime1;
+    i += 8;
+  }
+  std::uint64_t tail = 0;
+  for (size_t shift = 0; i < size; ++i, shift += 8) {
+    tail |= static_cast<std::uint64_t>(data[i]) << shift;
+  }
+  h2 = std::rotl(h2 ^ (tail * kPrime2), 31) * kPrime1;
+  return Mix(h1 ^ std::rotl(h2, 17) ^ size);
+}
+
+Fingerprint fingerprint(scnr::StreamData stream) {
+  Fingerprint retval{.size = stream.size()};
+  std::vector<Byte> buf(std::min<std::uint64_t>(retval.size, kFingerprintChunk));
+  for (std::uint64_t pos = 0; pos < retval.size; pos += buf.size()) {
+    stream.poll();
+    const size_t nbytes = stream.readsome(buf.data(), pos, buf.size());
+    retval.hash = hash_bytes(buf.data(), nbytes, retval.hash);
+    if (nbytes < buf.size()) {
+      break;
+    }
+  }
+  return retval;
+}
+
+}  // namespace scnr
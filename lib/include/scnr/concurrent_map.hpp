@@ -0,0 +1,69 @@
+#pragma once
+
+#include <array>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+namespace scnr {
+
+template <typename K, typename Hash = std::hash<K>, size_t Shards = 64>
+class ConcurrentSet {
+ public:
+  // Returns true if the key has not been seen before
+  bool Insert(const K& key) {
+    auto& shard = shards_[Hash{}(key) % Shards];
+    std::lock_guard lock(shard.mutex);
+    return shard.set.insert(key).second;
+  }
+
+ private:
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_set<K, Hash> set;
+  };
+  std::array<Shard, Shards> shards_;
+};
+
+// Memoizes values computed once per key
+template <typename K, typename V, typename Hash = std::hash<K>, size_t Shards = 64>
+class ConcurrentMemo {
+ public:
+  // Only the first caller for the key runs compute(), concurrent callers of the same key block until
+  // its value (or exception) is ready
+  // Second is true for the caller that has computed the value
+  template <typename Func>
+  std::pair<V, bool> GetOrCompute(const K& key, Func&& compute) {
+    auto& shard = shards_[Hash{}(key) % Shards];
+    std::unique_lock lock(shard.mutex);
+    if (auto it = shard.map.find(key); it != shard.map.end()) {
+      auto future = it->second;
+      lock.unlock();
+      return {future.get(), false};
+    }
+    std::promise<V> promise;
+    shard.map.emplace(key, promise.get_future().share());
+    lock.unlock();
+
+    try {
+      V value = compute();
+      promise.set_value(value);
+      return {std::move(value), true};
+    } catch (...) {
+      promise.set_exception(std::current_exception());
+      throw;
+    }
+  }
+
+ private:
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_map<K, std::shared_future<V>, Hash> map;
+  };
+  std::array<Shard, Shards> shards_;
+};
+
+}  // namespace scnr
@@ -1,9 +1,15 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
 
 namespace scnr {
 
+using Clock = std::chrono::steady_clock;
+
 class Context {
  public:
   void RequestStop() noexcept {
@@ -11,13 +17,83 @@ class Context {
   }
 
   bool StopRequested() const noexcept {
-    return stop_requested_.test();
+    return stop_requested_.test() || DeadlineExceeded();
+  }
+
+  // Scan-wide deadline, must be set before any worker has started
+  void SetDeadline(Clock::time_point deadline) noexcept {
+    deadline_ = deadline;
+  }
+
+  // Also latches the deadline as hit, see DeadlineHit
+  bool DeadlineExceeded() const noexcept {
+    if (deadline_ && Clock::now() >= deadline_.value()) {
+      deadline_hit_.test_and_set();
+      return true;
+    }
+    return false;
+  }
+
+  // A check during the scan saw the deadline pass. Unlike DeadlineExceeded it does not consult the clock, so it
+  // stays as the workers left it once they have finished
+  bool DeadlineHit() const noexcept {
+    return deadline_hit_.test();
+  }
+
+  // The scan was stopped by a request or by the deadline, without consulting the clock
+  bool Stopped() const noexcept {
+    return stop_requested_.test() || deadline_hit_.test();
   }
 
  private:
   std::atomic_flag stop_requested_ = ATOMIC_FLAG_INIT;
+  mutable std::atomic_flag deadline_hit_ = ATOMIC_FLAG_INIT;
+  std::optional<Clock::time_point> deadline_;
 };
 
 extern Context gContext;
 
+// Thrown from a polling point when the scan is being stopped
+class Cancelled : public std::runtime_error {
+ public:
+  Cancelled() : std::runtime_error("scan cancelled") {
+  }
+};
+
+// Thrown from a polling point when the per-file deadline has passed
+class TimedOut : public std::runtime_error {
+ public:
+  TimedOut() : std::runtime_error("file deadline exceeded") {
+  }
+};
+
+// Cancellation state of a single file, polled by long-running detector loops
+class CancelToken {
+ public:
+  explicit CancelToken(const Context* ctx = nullptr, std::optional<Clock::time_point> deadline = {})
+    : ctx_(ctx), deadline_(deadline) {
+  }
+
+  // The context and the clock are consulted on the first call and then every kPollInterval calls
+  void Poll() const {
+    if (polls_++ % kPollInterval != 0) {
+      return;
+    }
+    if (ctx_ && ctx_->StopRequested()) {
+      throw Cancelled();
+    }
+    if (deadline_ && Clock::now() >= deadline_.value()) {
+      throw TimedOut();
+    }
+  }
+
+ private:
+  // detector loops poll once per chunk of about 1 KiB
+  static constexpr std::uint32_t kPollInterval = 64;
+
+  const Context* ctx_ = nullptr;
+  std::optional<Clock::time_point> deadline_;
+  mutable std::uint32_t polls_ = 0;
+};
+
 }  // namespace  scnr
@@ -1,15 +1,46 @@
 #pragma once
 
+#include <scnr/context.hpp>
 #include <scnr/types.hpp>
 
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <memory>
 #include <sstream>
 #include <stdexcept>
 
 namespace scnr {
+
+// Upper bound on the I/O a header parser may spend on one file, reads beyond it fail
+class ReadBudget {
+ public:
+  ReadBudget(size_t reads, size_t bytes) : reads_(reads), bytes_(bytes) {
+  }
+
+  bool Spend(size_t bytes) {
+    if (reads_ == 0 || bytes > bytes_) {
+      exhausted_ = true;
+      return false;
+    }
+    reads_ -= 1;
+    bytes_ -= bytes;
+    return true;
+  }
+
+  // Tells a failed read caused by the budget from a truncated file
+  bool Exhausted() const {
+    return exhausted_;
+  }
+
+ private:
+  size_t reads_ = 0;
+  size_t bytes_ = 0;
+  bool exhausted_ = false;
+};
+
 class StreamData {
  public:
   StreamData(std::istream* stream = nullptr, size_t offset = 0) : stream_(stream), offset_(offset) {
@@ -27,6 +58,13 @@ class StreamData {
     if (not stream_) {
       return 0;
     }
+    if (from >= limit_) {
+      return 0;
+    }
+    count = std::min(count, limit_ - from);
+    if (budget_ && not budget_->Spend(count)) {
+      return 0;
+    }
     stream_->clear();
     stream_->seekg(offset_ + from);
     stream_->read(reinterpret_cast<char*>(dst), count);
@@ -44,21 +82,73 @@ class StreamData {
     return read(reinterpret_cast<Byte*>(std::addressof(result)), from, sizeof(result));
   }
 
+  // Number of bytes from the stream offset to the end, or to the limit of a slice
+  size_t size() const {
+    if (not stream_) {
+      return 0;
+    }
+    stream_->clear();
+    stream_->seekg(0, std::ios::end);
+    std::streamoff end = stream_->tellg();
+    if (end < 0 || static_cast<size_t>(end) < offset_) {
+      return 0;
+    }
+    return std::min(static_cast<size_t>(end) - offset_, limit_);
+  }
+
   StreamData advanced(size_t offset) const {
-    return StreamData(stream_, offset_ + offset);
+    return StreamData(stream_, offset_ + offset, offset < limit_ ? limit_ - offset : 0, token_, budget_);
+  }
+
+  // View of count bytes from offset, e.g. an archive member; reads past its end come back short
+  StreamData sliced(size_t offset, size_t count) const {
+    return StreamData(stream_, offset_ + offset, offset < limit_ ? std::min(count, limit_ - offset) : 0, token_,
+                      budget_);
+  }
+
+  // Stream over other data, e.g. decompressed content, that polls the same token
+  StreamData redirected(std::istream* stream) const {
+    return StreamData(stream, 0, std::numeric_limits<size_t>::max(), token_, nullptr);
+  }
+
+  // Copy of the stream whose poll() reports cancellation through the token
+  StreamData cancellable(const CancelToken* token) const {
+    return StreamData(stream_, offset_, limit_, token, budget_);
+  }
+
+  // Copy of the stream whose reads are charged to the budget
+  StreamData budgeted(ReadBudget* budget) const {
+    return StreamData(stream_, offset_, limit_, token_, budget);
+  }
+
+  // Called by detector loops once per chunk or header, throws Cancelled or TimedOut
+  void poll() const {
+    if (token_) {
+      token_->Poll();
+    }
+  }
+
+ private:
+  StreamData(std::istream* stream, size_t offset, size_t limit, const CancelToken* token, ReadBudget* budget)
+    : stream_(stream), offset_(offset), limit_(limit), token_(token), budget_(budget) {
   }
 
  private:
   mutable std::istream* stream_;
   const size_t offset_ = 0;
+  // bytes readable from offset_
+  const size_t limit_ = std::numeric_limits<size_t>::max();
   mutable size_t nextpos_ = 0;
+  const CancelToken* token_ = nullptr;
+  ReadBudget* budget_ = nullptr;
 };
 
 class File {
  public:
-  File(std::filesystem::path path)
+  // verify_regular=false skips the stat when the caller already knows the path is a regular file
+  File(std::filesystem::path path, bool verify_regular = true)
     : path_(std::move(path)), fstream_(std::make_unique<std::fstream>(path_, std::ios::in | std::ios::binary)) {
-    if (!std::filesystem::is_regular_file(path_)) {
+    if (verify_regular && !std::filesystem::is_regular_file(path_)) {
       std::stringstream ss;
       // u8
       ss << "Could not open file '" << path_.string() << "': is not a regular file";
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <scnr/file.hpp>
+#include <scnr/types.hpp>
+#include <scnr/util.hpp>
+
+#include <cstdint>
+
+namespace scnr {
+
+// Identity of file content: the size and a hash of every byte. A result reused for equal fingerprints carries
+// per-file details such as a build id, so files that only share their head and tail must not collide
+struct Fingerprint {
+  std::uint64_t size = 0;
+  std::uint64_t hash = 0;
+
+  bool operator==(const Fingerprint& rhs) const noexcept {
+    return size == rhs.size && hash == rhs.hash;
+  }
+};
+
+// Content is hashed in chunks of that size, each chunk seeds the next
+constexpr size_t kFingerprintChunk = 64 * 1024;
+
+std::uint64_t hash_bytes(const Byte* data, size_t size, std::uint64_t seed = 0);
+
+Fingerprint fingerprint(scnr::StreamData stream);
+
+}  // namespace scnr
+
+template <>
+struct std::hash<scnr::Fingerprint> {
+  inline std::size_t operator()(const scnr::Fingerprint& fp) const noexcept {
+    // already well mixed
+    return fp.hash ^ fp.size;
+  }
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <scnr/file.hpp>
+#include <scnr/types.hpp>
+
+#include <cstdint>
+#include <istream>
+#include <streambuf>
+#include <vector>
+
+namespace scnr {
+
+// Raw DEFLATE (RFC 1951) decoder producing output on demand, only as much input is read as the requested
+// output needs. Huffman codes are decoded canonically bit by bit, which is fast enough for the few KiB or MiB
+// detectors look at
+class Inflater {
+ public:
+  // Compressed data starts at offset 0 of the input
+  explicit Inflater(StreamData input);
+
+  // Decompresses up to count bytes, fewer at the end of the stream or on corrupt input
+  size_t Read(Byte* dst, size_t count);
+
+  // The final block has been decoded completely
+  bool Finished() const {
+    return state_ == State::kDone && copy_left_ == 0;
+  }
+
+  // Corrupt or truncated input
+  bool Failed() const {
+    return state_ == State::kError;
+  }
+
+  // Compressed bytes consumed so far; once finished, the offset of whatever follows the deflate stream
+  uint64_t Consumed() const {
+    return in_pos_ - (in_len_ - in_idx_) - bitcnt_ / 8;
+  }
+
+  struct Huffman {
+    std::uint16_t count[16] = {};
+    std::uint16_t symbol[288] = {};
+  };
+
+ private:
+  enum class State { kHeader, kStored, kHuffman, kDone, kError };
+
+  bool Fill();
+  bool Bits(int n, std::uint32_t& value);
+  int Decode(const Huffman& huffman);
+  bool ReadHeader();
+  bool ReadDynamicTables();
+  void Emit(Byte b, Byte* dst, size_t& produced);
+
+  StreamData input_;
+  uint64_t in_pos_ = 0;
+  Byte in_buf_[4096];
+  size_t in_len_ = 0;
+  size_t in_idx_ = 0;
+  std::uint64_t bitbuf_ = 0;
+  int bitcnt_ = 0;
+
+  State state_ = State::kHeader;
+  bool last_ = false;
+  size_t stored_left_ = 0;
+  size_t copy_left_ = 0;
+  size_t copy_dist_ = 0;
+  Huffman lencode_;
+  Huffman distcode_;
+
+  // the last 32 KiB of output, wpos_ counts all of it
+  std::vector<Byte> window_;
+  uint64_t wpos_ = 0;
+};
+
+// Input stream over inflated data. Data is inflated only as far as reads and seeks reach and kept in memory,
+// the stream ends after cap bytes. Seeking to the end inflates up to the cap
+class InflatingStream : public std::istream {
+ public:
+  InflatingStream(StreamData compressed, size_t cap) : std::istream(nullptr), buf_(compressed, cap) {
+    rdbuf(&buf_);
+  }
+
+ private:
+  class Buffer : public std::streambuf {
+   public:
+    Buffer(StreamData compressed, size_t cap) : inflater_(compressed), cap_(cap) {
+    }
+
+   protected:
+    int_type underflow() override;
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override;
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+
+   private:
+    // Inflates until size bytes are available, the data ends or the cap is reached; keeps the read position
+    void Extend(size_t size);
+
+    Inflater inflater_;
+    size_t cap_;
+    std::vector<char> data_;
+  };
+
+  Buffer buf_;
+};
+
+}  // namespace scnr
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+
+namespace scnr {
+
+// Value of a constant with the name of its macro
+template <typename Key>
+struct NamedValue {
+  Key value;
+  std::string_view name;
+};
+
+#define SCNR_NAMED(code) {code, #code}
+
+// Names of constants, e.g. machine types, with the common prefix of their macros stripped at compile time.
+// The table is a perfect hash built by hash and displace: keys are spread over buckets, every bucket gets the
+// displacement that moves all its keys to free slots. A lookup hashes twice and compares one key
+template <typename Key, size_t N>
+class NameTable {
+ public:
+  consteval NameTable(const NamedValue<Key> (&entries)[N], std::string_view prefix) {
+    for (size_t i = 0; i < N; ++i) {
+      for (size_t j = 0; j < i; ++j) {
+        if (entries[i].value == entries[j].value) {
+          throw std::logic_error("values with several names");
+        }
+      }
+    }
+    std::array<size_t, kBuckets> sizes{};
+    for (const auto& entry : entries) {
+      if (entry.name.size() <= prefix.size() || entry.name.substr(0, prefix.size()) != prefix) {
+        throw std::logic_error("name without the prefix");
+      }
+      sizes[Mix(AsKey(entry.value)) & (kBuckets - 1)] += 1;
+    }
+    // large buckets first, they are the hardest to place
+    std::array<size_t, kBuckets> order{};
+    for (size_t i = 0; i < kBuckets; ++i) {
+      order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) {
+      return sizes[lhs] > sizes[rhs];
+    });
+
+    for (size_t bucket : order) {
+      if (sizes[bucket] == 0) {
+        break;
+      }
+      std::array<size_t, N> members{};
+      size_t nmembers = 0;
+      for (size_t i = 0; i < N; ++i) {
+        if ((Mix(AsKey(entries[i].value)) & (kBuckets - 1)) == bucket) {
+          members[nmembers++] = i;
+        }
+      }
+      Place(entries, prefix, bucket, members, nmembers);
+    }
+  }
+
+  // Empty for values without a name
+  constexpr std::string_view operator[](Key value) const {
+    const std::uint64_t key = AsKey(value);
+    const Slot& slot = slots_[SlotOf(key, displacements_[Mix(key) & (kBuckets - 1)])];
+    return slot.key == key ? slot.name : std::string_view{};
+  }
+
+ private:
+  // half of the slots stay free, buckets of four keys on average find a displacement after a few tries
+  static constexpr size_t kSlots = std::bit_ceil(2 * N);
+  static constexpr size_t kBuckets = std::max<size_t>(1, std::bit_ceil(N) / 4);
+
+  struct Slot {
+    // an unused slot has no name, whatever key it matches
+    std::uint64_t key = 0;
+    std::string_view name;
+  };
+
+  static constexpr std::uint64_t AsKey(Key value) {
+    return static_cast<std::uint64_t>(static_cast<std::make_unsigned_t<Key>>(value));
+  }
+
+  // splitmix64 finalizer
+  static constexpr std::uint64_t Mix(std::uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+  }
+
+  static constexpr size_t SlotOf(std::uint64_t key, std::uint16_t displacement) {
+    return Mix(key + (displacement + 1) * 0x9e3779b97f4a7c15) & (kSlots - 1);
+  }
+
+  consteval void Place(const NamedValue<Key> (&entries)[N], std::string_view prefix, size_t bucket,
+                       const std::array<size_t, N>& members, size_t nmembers) {
+    for (std::uint32_t displacement = 0; displacement <= 0xffff; ++displacement) {
+      std::array<size_t, N> slots{};
+      bool free = true;
+      for (size_t m = 0; m < nmembers && free; ++m) {
+        slots[m] = SlotOf(AsKey(entries[members[m]].value), displacement);
+        const auto placed = slots.begin() + m;
+        free = slots_[slots[m]].name.empty() && std::find(slots.begin(), placed, slots[m]) == placed;
+      }
+      if (!free) {
+        continue;
+      }
+      displacements_[bucket] = displacement;
+      for (size_t m = 0; m < nmembers; ++m) {
+        slots_[slots[m]] = Slot{.key = AsKey(entries[members[m]].value),
+                                .name = entries[members[m]].name.substr(prefix.size())};
+      }
+      return;
+    }
+    throw std::logic_error("no displacement places the bucket");
+  }
+
+  std::array<Slot, kSlots> slots_{};
+  std::array<std::uint16_t, kBuckets> displacements_{};
+};
+
+}  // namespace scnr
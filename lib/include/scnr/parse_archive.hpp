@@ -0,0 +1,67 @@
+#pragma once
+
+#include <scnr/file.hpp>
+#include <scnr/types.hpp>
+#include <scnr/util.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <ostream>
+#include <string_view>
+
+namespace scnr {
+
+// Properties of a single archive
+struct ArchiveDetails {
+  // members handed to the visitor
+  std::uint64_t members = 0;
+  // the visitor stopped the iteration before the end of the archive
+  bool truncated = false;
+
+  bool operator==(const ArchiveDetails& rhs) const noexcept {
+    return members == rhs.members && truncated == rhs.truncated;
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const ArchiveDetails& details) {
+    return os << "members = " << details.members << (details.truncated ? ", truncated" : "");
+  }
+};
+
+struct ArchiveFile {
+  // ar, tar, or zip and the zip based jar, apk, wheel and nupkg
+  std::string_view format;
+  ArchiveDetails details;
+
+  bool operator==(const ArchiveFile& rhs) const noexcept {
+    return format == rhs.format && details == rhs.details;
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const ArchiveFile& file) {
+    return os << "archive = [" << file.format << "]";
+  }
+};
+
+// Receives the content of every regular member as a slice of the archive stream, nothing is extracted; deflated
+// zip members come as a stream over their first KiBs. Returning false stops the iteration. An empty visitor
+// only identifies the archive
+using MemberVisitor = std::function<bool(scnr::StreamData member)>;
+
+// Zip from its central directory, only the end records, the directory and the probed members are read
+std::optional<ArchiveFile> try_zip(scnr::StreamData stream, const MemberVisitor& visit = {});
+// Where the zip begins in the stream according to its central directory, past 0 if something is prepended
+std::optional<std::uint64_t> zip_offset(scnr::StreamData stream);
+
+// Zip, Unix ar (static libraries, .deb) and tar (ustar, GNU, pax and v7 headers)
+std::optional<ArchiveFile> try_archive(scnr::StreamData stream, const MemberVisitor& visit = {});
+// Bytes a tar takes up to its end-of-archive blocks; one without them ends behind the last header that parses
+std::optional<std::uint64_t> tar_size(scnr::StreamData stream);
+
+}  // namespace scnr
+
+template <>
+struct std::hash<scnr::ArchiveFile> {
+  inline std::size_t operator()(const scnr::ArchiveFile& archive) const noexcept {
+    return std::hash<std::string_view>{}(archive.format);
+  }
+};
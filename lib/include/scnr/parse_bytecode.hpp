@@ -0,0 +1,133 @@
+#pragma once
+
+#include <scnr/file.hpp>
+#include <scnr/types.hpp>
+#include <scnr/util.hpp>
+
+#include <cstdint>
+#include <iomanip>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace scnr {
+
+// WebAssembly binary, a core module or a component of the component model
+struct WasmFile {
+  std::uint16_t version = 0;
+  bool component = false;
+
+  bool operator==(const WasmFile& rhs) const noexcept {
+    return version == rhs.version && component == rhs.component;
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const WasmFile& file) {
+    return os << "wasm = [" << (file.component ? "component" : "module") << ", " << file.version << "]";
+  }
+};
+
+// Compiled Java class, the class file version tells the Java release it targets
+struct JavaClassFile {
+  std::uint16_t major = 0;
+  std::uint16_t minor = 0;
+
+  bool operator==(const JavaClassFile& rhs) const noexcept {
+    return major == rhs.major && minor == rhs.minor;
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const JavaClassFile& file) {
+    // 45 to 48 are Java 1.1 to 1.4, 49 is Java 5 and every release since adds one
+    os << "java-class = [Java " << (file.major < 49 ? "1." : "") << (file.major - 44);
+    return os << (file.minor == 0xffff ? ", preview]" : "]");
+  }
+};
+
+// Dalvik executable of Android, compact dex is the variant the runtime creates on the device
+struct DexFile {
+  std::uint16_t version = 0;
+  bool compact = false;
+
+  bool operator==(const DexFile& rhs) const noexcept {
+    return version == rhs.version && compact == rhs.compact;
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const DexFile& file) {
+    return os << (file.compact ? "cdex = [" : "dex = [") << std::setw(3) << std::setfill('0') << file.version
+              << std::setfill(' ') << "]";
+  }
+};
+
+// Properties that identify a single module rather than a kind of module
+struct BitcodeDetails {
+  // compiler that wrote the module, e.g. LLVM17.0.6
+  std::string producer;
+
+  bool operator==(const BitcodeDetails& rhs) const noexcept {
+    return producer == rhs.producer;
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const BitcodeDetails& details) {
+    return os << "producer = " << details.producer;
+  }
+};
+
+// LLVM bitcode module, raw or in the wrapper Apple toolchains emit
+struct BitcodeFile {
+  // target triple of the module, e.g. x86_64-pc-linux-gnu; empty if the module does not set one
+  std::string triple;
+  BitcodeDetails details;
+
+  bool operator==(const BitcodeFile& rhs) const noexcept {
+    return triple == rhs.triple && details == rhs.details;
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const BitcodeFile& file) {
+    return os << "bitcode = [" << (file.triple.empty() ? "unknown" : file.triple) << "]";
+  }
+};
+
+std::optional<WasmFile> try_wasm(scnr::StreamData stream);
+std::optional<JavaClassFile> try_java_class(scnr::StreamData stream);
+std::optional<DexFile> try_dex(scnr::StreamData stream);
+// The triple is taken from the module block, blocks in front of it are skipped by their length
+std::optional<BitcodeFile> try_bitcode(scnr::StreamData stream);
+
+}  // namespace scnr
+
+template <>
+struct std::hash<scnr::WasmFile> {
+  inline std::size_t operator()(const scnr::WasmFile& wasm) const noexcept {
+    std::uint64_t ret = 0;
+    scnr::hash_combine(ret, std::hash<std::uint16_t>{}(wasm.version));
+    scnr::hash_combine(ret, std::hash<bool>{}(wasm.component));
+    return ret;
+  }
+};
+
+template <>
+struct std::hash<scnr::JavaClassFile> {
+  inline std::size_t operator()(const scnr::JavaClassFile& java) const noexcept {
+    std::uint64_t ret = 0;
+    scnr::hash_combine(ret, std::hash<std::uint16_t>{}(java.major));
+    scnr::hash_combine(ret, std::hash<std::uint16_t>{}(java.minor));
+    return ret;
+  }
+};
+
+template <>
+struct std::hash<scnr::DexFile> {
+  inline std::size_t operator()(const scnr::DexFile& dex) const noexcept {
+    std::uint64_t ret = 0;
+    scnr::hash_combine(ret, std::hash<std::uint16_t>{}(dex.version));
+    scnr::hash_combine(ret, std::hash<bool>{}(dex.compact));
+    return ret;
+  }
+};
+
+template <>
+struct std::hash<scnr::BitcodeFile> {
+  inline std::size_t operator()(const scnr::BitcodeFile& bitcode) const noexcept {
+    return std::hash<std::string>{}(bitcode.triple);
+  }
+};
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <scnr/file.hpp>
+#include <scnr/types.hpp>
+
+#include <functional>
+#include <optional>
+#include <string_view>
+
+namespace scnr {
+
+// Receives the decompressed content of a compressed file as a stream of its own
+using ContentVisitor = std::function<void(scnr::StreamData content)>;
+
+// gzip, xz or zstd. The content of gzip files is handed to the visitor, it is inflated only as far as the
+// visitor reads and at most max_content bytes; xz and zstd are identified only
+std::optional<std::string_view> try_compressed(scnr::StreamData stream, size_t max_content,
+                                               const ContentVisitor& visit);
+
+}  // namespace scnr
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <scnr/file.hpp>
+#include <scnr/types.hpp>
+#include <scnr/util.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace scnr {
+
+// File matched by a user-supplied magic rule
+struct CustomFile {
+  // name given by the rule
+  std::string name;
+
+  bool operator==(const CustomFile& rhs) const noexcept {
+    return name == rhs.name;
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const CustomFile& file) {
+    return os << "custom = [" << file.name << "]";
+  }
+};
+
+// Magic rules compiled for matching all of them at once. Rules are grouped by their offset and the mask of their
+// first four bytes; a group looks up the masked head bytes as a key and verifies only the rules with that key,
+// so the cost grows with the number of groups, not of rules
+class MagicRules {
+ public:
+  // One rule per line: offset (decimal or 0x hex), magic bytes in hex with an optional /mask in hex of the same
+  // length, and the name, e.g. "0x10 cafe00d0/ffff00ff acme firmware". Empty lines and lines starting with # are
+  // skipped. Throws std::runtime_error naming the line of a malformed rule
+  static MagicRules Parse(std::istream& in);
+  static MagicRules Load(const std::filesystem::path& path);
+
+  // Name of the first rule, in file order, that matches the head of a file
+  std::optional<std::string_view> Match(const Byte* head, size_t size) const;
+
+  // Bytes from the start of a file the rules look at
+  size_t HeadSize() const {
+    return head_size_;
+  }
+
+  size_t size() const {
+    return rules_.size();
+  }
+
+ private:
+  struct Rule {
+    size_t offset = 0;
+    // masked magic and the mask, padded with zeros to whole words
+    std::vector<std::uint64_t> magic;
+    std::vector<std::uint64_t> mask;
+    size_t length = 0;
+    std::string name;
+  };
+
+  struct Group {
+    size_t offset = 0;
+    std::uint32_t mask = 0;
+    // masked key of the first four bytes and the rule index, sorted
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> keys;
+  };
+
+  bool Verify(const Rule& rule, const Byte* head, size_t size) const;
+
+  std::vector<Rule> rules_;
+  std::vector<Group> groups_;
+  size_t head_size_ = 0;
+};
+
+// Reads the head once and matches it against every rule
+std::optional<CustomFile> try_custom(scnr::StreamData stream, const MagicRules& rules);
+
+}  // namespace scnr
+
+template <>
+struct std::hash<scnr::CustomFile> {
+  inline std::size_t operator()(const scnr::CustomFile& custom) const noexcept {
+    return std::hash<std::string>{}(custom.name);
+  }
+};
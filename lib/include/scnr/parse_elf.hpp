@@ -5,24 +5,53 @@
 
 #include <optional>
 #include <ostream>
+#include <string>
+#include <vector>
 
 namespace scnr {
 
+// Properties that identify a single binary rather than a kind of binary
+struct ElfDetails {
+  // DT_NEEDED entries in the order of the dynamic section
+  std::vector<std::string> needed;
+  // DT_SONAME
+  std::string soname;
+  // NT_GNU_BUILD_ID as lowercase hex
+  std::string build_id;
+
+  bool operator==(const ElfDetails& rhs) const noexcept {
+    return needed == rhs.needed && soname == rhs.soname && build_id == rhs.build_id;
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const ElfDetails& details) {
+    os << "needed = [";
+    for (size_t i = 0; i < details.needed.size(); ++i) {
+      os << (i ? ", " : "") << details.needed[i];
+    }
+    return os << "], soname = " << details.soname << ", build-id = " << details.build_id;
+  }
+};
+
 struct ElfFile {
   std::endian endian = {};
   bool w64 = false;
   std::string_view cputype;
   std::string interpreter;
+  // no SHT_SYMTAB section, or no section header table at all
+  bool stripped = false;
+  ElfDetails details;
 
   bool operator==(const ElfFile& rhs) const noexcept {
-    return endian == rhs.endian && w64 == rhs.w64 && cputype == rhs.cputype && interpreter == rhs.interpreter;
+    return endian == rhs.endian && w64 == rhs.w64 && cputype == rhs.cputype && interpreter == rhs.interpreter &&
+           stripped == rhs.stripped && details == rhs.details;
   }
 
   friend std::ostream& operator<<(std::ostream& os, const ElfFile& file) {
     return os << "elf = ["
               << (file.endian == std::endian::little ? "little, "
                                                      : (file.endian == std::endian::big ? "big, " : "native, "))
-              << file.cputype << ", " << (file.w64 ? "x64, " : "x32, ") << file.interpreter << "]";
+              << file.cputype << ", " << (file.w64 ? "x64, " : "x32, ") << file.interpreter
+              << (file.stripped ? ", stripped" : "") << "]";
   }
 };
 
@@ -38,6 +67,7 @@ struct std::hash<scnr::ElfFile> {
     scnr::hash_combine(ret, std::hash<bool>{}(elf.w64));
     scnr::hash_combine(ret, std::hash<std::string_view>{}(elf.cputype));
     scnr::hash_combine(ret, std::hash<std::string>{}(elf.interpreter));
+    scnr::hash_combine(ret, std::hash<bool>{}(elf.stripped));
     return ret;
   }
 };
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <scnr/types.hpp>
 #include <scnr/util.hpp>
 
+#include <cstddef>
 #include <optional>
 #include <ostream>
 #include <string_view>
@@ -22,10 +23,43 @@ struct TxtFile {
   }
 };
 
+// Binary data declared by the head alone, no text check has looked at it
+struct DataFile {
+  bool operator==(const DataFile&) const noexcept {
+    return true;
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const DataFile&) {
+    return os << "data";
+  }
+};
+
+// When the head of a file counts as binary data. Text in UTF-16 or UTF-32 has NUL bytes in the high byte lanes
+// of its code units only, 8-bit text and UTF-8 has none at all; binary formats have them at every offset
+struct DataHeuristic {
+  // bytes looked at from the start, at most 16 KiB; 0 turns the heuristic off. Files shorter than 64 bytes are
+  // left to the text checks
+  size_t head = 4096;
+  // share of NUL bytes every lane of the head, the bytes at offsets of the same remainder modulo 4, reaches; in
+  // percent from 1 to 100, 0 would make every head data
+  unsigned nul_percent = 10;
+};
+
+std::optional<DataFile> try_data(scnr::StreamData stream, const DataHeuristic& heuristic);
+
 std::optional<TxtFile> try_txt(scnr::StreamData stream);
+// Looks at no more than max_bytes from the start, a sequence cut off by that limit does not rule out an encoding
+std::optional<TxtFile> try_txt(scnr::StreamData stream, size_t max_bytes);
 
 }  // namespace scnr
 
+template <>
+struct std::hash<scnr::DataFile> {
+  inline std::size_t operator()(const scnr::DataFile&) const noexcept {
+    return 0;
+  }
+};
+
 template <>
 struct std::hash<scnr::TxtFile> {
   std::size_t operator()(const scnr::TxtFile& txt) const noexcept {
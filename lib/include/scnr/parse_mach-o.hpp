@@ -7,27 +7,70 @@
 #include <bit>
 #include <cstdint>
 #include <optional>
+#include <string>
 #include <string_view>
 #include <variant>
 #include <vector>
 
 namespace scnr {
 
+// Properties that identify a single binary rather than a kind of binary
+struct MachODetails {
+  // LC_LOAD_DYLIB and its weak, re-export, lazy and upward variants in load command order
+  std::vector<std::string> dylibs;
+  // install name from LC_ID_DYLIB
+  std::string id;
+  // LC_UUID as uppercase 8-4-4-4-12 hex
+  std::string uuid;
+  // minimum OS version from LC_BUILD_VERSION or LC_VERSION_MIN_*, e.g. 13.0
+  std::string minos;
+  // bytes reserved for the code signature by LC_CODE_SIGNATURE
+  std::uint32_t signature_size = 0;
+
+  bool operator==(const MachODetails& rhs) const noexcept {
+    return dylibs == rhs.dylibs && id == rhs.id && uuid == rhs.uuid && minos == rhs.minos &&
+           signature_size == rhs.signature_size;
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const MachODetails& details) {
+    os << "dylibs = [";
+    for (size_t i = 0; i < details.dylibs.size(); ++i) {
+      os << (i ? ", " : "") << details.dylibs[i];
+    }
+    return os << "], id = " << details.id << ", uuid = " << details.uuid << ", minos = " << details.minos
+              << ", signature = " << details.signature_size;
+  }
+};
+
 struct MachOSingle {
   std::endian endian = {};
   bool w64 = false;
   std::string_view cputype;
+  // CPU_SUBTYPE_* without the prefix, e.g. ARM64E or X86_64_H; the *_ALL subtypes are left out when printed
+  std::string_view cpusubtype;
   bool issigned = false;
+  // PLATFORM_* without the prefix, e.g. MACOS or IOS
+  std::string_view platform;
+  MachODetails details;
 
   bool operator==(const MachOSingle& rhs) const noexcept {
-    return endian == rhs.endian && w64 == rhs.w64 && cputype == rhs.cputype && issigned == rhs.issigned;
+    return endian == rhs.endian && w64 == rhs.w64 && cputype == rhs.cputype && cpusubtype == rhs.cpusubtype &&
+           issigned == rhs.issigned && platform == rhs.platform && details == rhs.details;
+  }
+
+  // cpusubtype unless it is the *_ALL subtype that runs on every CPU of the type
+  std::string_view SpecificSubtype() const {
+    return cpusubtype.ends_with("_ALL") ? std::string_view{} : cpusubtype;
   }
 
   friend std::ostream& operator<<(std::ostream& os, const MachOSingle& file) {
     return os << "mach-o = ["
               << (file.endian == std::endian::little ? "little, "
                                                      : (file.endian == std::endian::big ? "big, " : "native, "))
-              << file.cputype << ", " << (file.w64 ? "x64, " : "x32, ") << (file.issigned ? "signed]" : "unsigned]");
+              << file.cputype << ", " << file.SpecificSubtype() << (file.SpecificSubtype().empty() ? "" : ", ")
+              << (file.w64 ? "x64, " : "x32, ")
+              << file.platform << (file.platform.empty() ? "" : ", ")
+              << (file.issigned ? "signed]" : "unsigned]");
   }
 };
 
@@ -69,6 +112,17 @@ struct MachOFile {
   }
 };
 
+// Details of every slice, see Detailed
+inline void print_details(std::ostream& os, const MachOFile& file) {
+  if (auto single = std::get_if<MachOSingle>(&file.value)) {
+    os << ", " << single->details;
+    return;
+  }
+  for (const auto& single : std::get<MachOFat>(file.value).files) {
+    os << ", " << single.cputype << " = [" << single.details << "]";
+  }
+}
+
 std::optional<MachOFile> try_macho(scnr::StreamData stream);
 
 }  // namespace scnr
@@ -80,7 +134,9 @@ struct std::hash<scnr::MachOSingle> {
     scnr::hash_combine(ret, std::hash<std::endian>{}(single.endian));
     scnr::hash_combine(ret, std::hash<bool>{}(single.w64));
     scnr::hash_combine(ret, std::hash<std::string_view>{}(single.cputype));
+    scnr::hash_combine(ret, std::hash<std::string_view>{}(single.cpusubtype));
     scnr::hash_combine(ret, std::hash<bool>{}(single.issigned));
+    scnr::hash_combine(ret, std::hash<std::string_view>{}(single.platform));
     return ret;
   }
 };
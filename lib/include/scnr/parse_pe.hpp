@@ -7,31 +7,73 @@
 #include <bit>
 #include <cstdint>
 #include <optional>
+#include <string>
 #include <string_view>
 #include <variant>
+#include <vector>
 
 namespace scnr {
 
+// Properties that identify a single image rather than a kind of image
+struct PEDetails {
+  // IMAGE_DLLCHARACTERISTICS_* bits of the optional header
+  std::uint16_t dll_characteristics = 0;
+  // DLL names of the import directory in its order
+  std::vector<std::string> imports;
+
+  bool operator==(const PEDetails& rhs) const noexcept {
+    return dll_characteristics == rhs.dll_characteristics && imports == rhs.imports;
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const PEDetails& details);
+};
+
 struct PEFile {
   std::endian endian = {};
   bool w64 = false;
   std::string_view cputype;
   bool managed = false;
+  // IMAGE_SUBSYSTEM_* without the prefix, e.g. WINDOWS_GUI, WINDOWS_CUI or NATIVE for drivers
+  std::string_view subsystem;
+  // has an Authenticode signature in the security directory, the signature is not verified
+  bool issigned = false;
+  PEDetails details;
 
   bool operator==(const PEFile& rhs) const noexcept {
-    return endian == rhs.endian && w64 == rhs.w64 && cputype == rhs.cputype && managed == rhs.managed;
+    return endian == rhs.endian && w64 == rhs.w64 && cputype == rhs.cputype && managed == rhs.managed &&
+           subsystem == rhs.subsystem && issigned == rhs.issigned && details == rhs.details;
   }
 
   friend std::ostream& operator<<(std::ostream& os, const PEFile& file) {
     return os << "PE = ["
               << (file.endian == std::endian::little ? "little, "
                                                      : (file.endian == std::endian::big ? "big, " : "native, "))
-              << file.cputype << ", " << (file.w64 ? "x64, " : "x32, ") << (file.managed ? "managed]" : "]");
+              << file.cputype << ", " << (file.w64 ? "x64, " : "x32, ") << file.subsystem
+              << (file.issigned ? ", signed" : "") << (file.managed ? ", managed]" : "]");
   }
 };
 
 std::optional<PEFile> try_pe(scnr::StreamData stream);
 
+// COFF object file as written by MSVC, e.g. an .obj or a member of a static .lib
+struct CoffFile {
+  std::string_view cputype;
+  // object, bigobj for objects with more than 65279 sections, or import for the short import members of import
+  // libraries
+  std::string_view format;
+
+  bool operator==(const CoffFile& rhs) const noexcept {
+    return cputype == rhs.cputype && format == rhs.format;
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const CoffFile& file) {
+    return os << "COFF = [" << file.cputype << ", " << file.format << "]";
+  }
+};
+
+// Objects have no magic, the machine, an empty optional header and a section table within the file identify them
+std::optional<CoffFile> try_coff(scnr::StreamData stream);
+
 }  // namespace scnr
 
 template <>
@@ -42,6 +84,18 @@ struct std::hash<scnr::PEFile> {
     scnr::hash_combine(ret, std::hash<bool>{}(pe.w64));
     scnr::hash_combine(ret, std::hash<std::string_view>{}(pe.cputype));
     scnr::hash_combine(ret, std::hash<bool>{}(pe.managed));
+    scnr::hash_combine(ret, std::hash<std::string_view>{}(pe.subsystem));
+    scnr::hash_combine(ret, std::hash<bool>{}(pe.issigned));
+    return ret;
+  }
+};
+
+template <>
+struct std::hash<scnr::CoffFile> {
+  inline std::size_t operator()(const scnr::CoffFile& coff) const noexcept {
+    std::uint64_t ret = 0;
+    scnr::hash_combine(ret, std::hash<std::string_view>{}(coff.cputype));
+    scnr::hash_combine(ret, std::hash<std::string_view>{}(coff.format));
     return ret;
   }
 };
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <scnr/types.hpp>
+#include <scnr/util.hpp>
+
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace scnr {
+
+// The interpreter line of a single script
+struct ScriptDetails {
+  // interpreter path as written, e.g. /usr/bin/env
+  std::string path;
+  // the rest of the line, e.g. python3 -u
+  std::string arguments;
+
+  bool operator==(const ScriptDetails& rhs) const noexcept {
+    return path == rhs.path && arguments == rhs.arguments;
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const ScriptDetails& details) {
+    return os << "shebang = " << details.path << (details.arguments.empty() ? "" : " ") << details.arguments;
+  }
+};
+
+struct ScriptFile {
+  // file name of the interpreter, or of the command env runs: sh, bash, python3, perl
+  std::string interpreter;
+  // encoding of the whole file, like TxtFile encodings or "binary"; empty unless it was asked for
+  std::string_view encoding;
+  ScriptDetails details;
+
+  bool operator==(const ScriptFile& rhs) const noexcept {
+    return interpreter == rhs.interpreter && encoding == rhs.encoding && details == rhs.details;
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const ScriptFile& file) {
+    os << "script = [" << file.interpreter;
+    if (!file.encoding.empty()) {
+      os << ", " << file.encoding;
+    }
+    return os << "]";
+  }
+};
+
+// "#!" line of at most 256 bytes, the limit of Linux. Only that line is read unless check_encoding asks for
+// the encoding of the whole file
+std::optional<ScriptFile> try_script(scnr::StreamData stream, bool check_encoding = false);
+
+}  // namespace scnr
+
+template <>
+struct std::hash<scnr::ScriptFile> {
+  inline std::size_t operator()(const scnr::ScriptFile& script) const noexcept {
+    std::uint64_t ret = 0;
+    scnr::hash_combine(ret, std::hash<std::string>{}(script.interpreter));
+    scnr::hash_combine(ret, std::hash<std::string_view>{}(script.encoding));
+    return ret;
+  }
+};
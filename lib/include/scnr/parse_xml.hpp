@@ -5,15 +5,32 @@
 
 #include <optional>
 #include <ostream>
+#include <string>
 #include <string_view>
 
 namespace scnr {
 
+// Properties of a single XML document
+struct XmlDetails {
+  // encoding attribute of the declaration, empty without one
+  std::string declared;
+
+  bool operator==(const XmlDetails& rhs) const noexcept {
+    return declared == rhs.declared;
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const XmlDetails& details) {
+    return os << "declared = " << details.declared;
+  }
+};
+
 struct XmlFile {
+  // encoding the content is valid in, named like TxtFile encodings
   std::string_view encoding;
+  XmlDetails details;
 
   bool operator==(const XmlFile& rhs) const noexcept {
-    return encoding == rhs.encoding;
+    return encoding == rhs.encoding && details == rhs.details;
   }
 
   friend std::ostream& operator<<(std::ostream& os, const XmlFile& file) {
@@ -21,7 +38,12 @@ struct XmlFile {
   }
 };
 
-std::optional<XmlFile> try_xml(scnr::StreamData stream);
+// Content validated by default, enough to tell the encoding of any real document
+inline constexpr size_t kXmlValidatedPrefix = 64 * 1024;
+
+// XML declaration in UTF-8 or 8-bit encodings and in UTF-16 with or without BOM. The encoding comes from
+// validating at most max_validated bytes, std::numeric_limits<size_t>::max() checks the whole file
+std::optional<XmlFile> try_xml(scnr::StreamData stream, size_t max_validated = kXmlValidatedPrefix);
 
 }  // namespace scnr
 
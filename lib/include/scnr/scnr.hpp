@@ -1,33 +1,254 @@
 #pragma once
 
+#include <scnr/concurrent_map.hpp>
+#include <scnr/context.hpp>
+#include <scnr/fingerprint.hpp>
+#include <scnr/parse_archive.hpp>
+#include <scnr/parse_bytecode.hpp>
+#include <scnr/parse_compressed.hpp>
+#include <scnr/parse_custom.hpp>
 #include <scnr/parse_elf.hpp>
 #include <scnr/parse_encoding.hpp>
 #include <scnr/parse_mach-o.hpp>
 #include <scnr/parse_pe.hpp>
+#include <scnr/parse_script.hpp>
 #include <scnr/parse_xml.hpp>
 #include <scnr/types.hpp>
+#include <scnr/walk.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <optional>
 #include <unordered_map>
 #include <utility>
 #include <variant>
+#include <vector>
 
 namespace scnr {
 
-using FileInfo = std::variant<std::monostate, ElfFile, MachOFile, PEFile, TxtFile, XmlFile>;
+// Detection did not finish before the per-file deadline
+struct TimedOutFile {
+  bool operator==(const TimedOutFile&) const noexcept {
+    return true;
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const TimedOutFile&) {
+    return os << "Timeout";
+  }
+};
+
+}  // namespace scnr
+
+template <>
+struct std::hash<scnr::TimedOutFile> {
+  inline std::size_t operator()(const scnr::TimedOutFile&) const noexcept {
+    return 0;
+  }
+};
+
+namespace scnr {
+
+struct CompressedContent;
+
+// File compressed as a whole, e.g. a gzipped log
+struct CompressedFile {
+  // gzip, xz or zstd
+  std::string_view format;
+  // what the decompressed data was detected as, nullptr if it was not decompressed
+  std::shared_ptr<const CompressedContent> content;
+
+  bool operator==(const CompressedFile& rhs) const noexcept;
+  friend std::ostream& operator<<(std::ostream& os, const CompressedFile& file);
+};
+
+}  // namespace scnr
+
+template <>
+struct std::hash<scnr::CompressedFile> {
+  std::size_t operator()(const scnr::CompressedFile& compressed) const noexcept;
+};
+
+namespace scnr {
+
+using FileInfo = std::variant<std::monostate, ElfFile, MachOFile, PEFile, TxtFile, XmlFile, ArchiveFile,
+                              CompressedFile, ScriptFile, CoffFile, WasmFile, JavaClassFile, DexFile, BitcodeFile,
+                              DataFile, CustomFile, TimedOutFile>;
+
+struct CompressedContent {
+  FileInfo info;
+};
+
+// Result of a file found inside a container, counted apart from the files on disk
+struct MemberInfo {
+  // format of the innermost container, e.g. ar
+  std::string_view container;
+  FileInfo info;
+
+  bool operator==(const MemberInfo& rhs) const noexcept {
+    return container == rhs.container && info == rhs.info;
+  }
+};
+
+}  // namespace scnr
+
+template <>
+struct std::hash<scnr::MemberInfo> {
+  inline std::size_t operator()(const scnr::MemberInfo& member) const noexcept {
+    std::uint64_t ret = 0;
+    scnr::hash_combine(ret, std::hash<std::string_view>{}(member.container));
+    scnr::hash_combine(ret, std::hash<scnr::FileInfo>{}(member.info));
+    return ret;
+  }
+};
+
+namespace scnr {
+
+// How far detect_content looks into containers
+struct ContainerOptions {
+  // members of containers nested deeper are not looked at, 0 only identifies containers
+  size_t max_depth = 1;
+  // members of a single container looked at, the rest is skipped
+  size_t max_members = 10000;
+  // decompressed bytes of a compressed file the detectors may look at
+  size_t max_decompressed = 1024 * 1024;
+  // scripts also get the encoding of their whole content, not just the interpreter of the first line
+  bool script_encoding = false;
+  // files whose head looks binary are reported as DataFile without running the script, XML and text checks
+  DataHeuristic data;
+  // user-supplied magic rules, matched before the built-in detectors
+  std::shared_ptr<const MagicRules> rules;
+};
+
+// Receives the result of every member looked at, from the thread that detects the container
+using MemberSink = std::function<void(const MemberInfo& member)>;
+
+// Payload that starts past the beginning of a file, e.g. the archive of a self-extracting installer
+struct EmbeddedFile {
+  size_t offset = 0;
+  FileInfo info;
+
+  bool operator==(const EmbeddedFile& rhs) const noexcept {
+    return offset == rhs.offset && info == rhs.info;
+  }
+};
+
+enum class Traversal {
+  // Every entry is a separate task in the pool queue, the walk ends up breadth-first
+  kBreadthFirst,
+  // Files of a directory are processed in FileOrder, in per-worker chunks; the walker descends into
+  // one subdirectory itself and exposes the rest as whole subtrees for other workers to pick up
+  kDepthFirst,
+};
+
+enum class HardLinks {
+  // every path is read and counted
+  kOff,
+  // an inode with several links is read once, its result is counted for every link
+  kCountLinks,
+  // an inode with several links is read and counted once
+  kCountInodes,
+};
+
+enum class Follow {
+  // symlinks found during the walk are skipped
+  kNever,
+  // symlinks to regular files are followed, symlinks to directories are skipped
+  kFiles,
+  // all symlinks are followed, directories are walked once per (st_dev, st_ino) so loops terminate
+  kAll,
+};
+
+struct ScanOptions {
+  Traversal traversal = Traversal::kDepthFirst;
+  // only applies to the depth-first traversal
+  FileOrder order = FileOrder::kInode;
+  // other than kOff also skips directories seen before, e.g. bind-mounted duplicate trees
+  HardLinks hardlinks = HardLinks::kOff;
+  // byte-identical files (by Fingerprint) are detected once, the result is counted for every copy;
+  // members of containers are counted for the first copy only
+  bool dedup_content = false;
+  // paths given to process() are always followed
+  Follow follow = Follow::kAll;
+  // checked between files and polled inside detectors, the walk stops once a stop is requested
+  const Context* ctx = nullptr;
+  // detection of a single file is abandoned after that time and reported as TimedOutFile
+  std::optional<std::chrono::milliseconds> file_timeout;
+  // called from worker threads with the result of every file, e.g. to list per-file details
+  std::function<void(const std::filesystem::path&, const FileInfo&)> on_file;
+  // if set, every file is also searched for embedded payloads, called with the ones found; not called for hard
+  // links and content duplicates whose result is reused
+  std::function<void(const std::filesystem::path&, const std::vector<EmbeddedFile>&)> on_embedded;
+  ContainerOptions containers;
+};
+
+struct ScanStats {
+  // paths resolved from an inode that had already been read through another hard link
+  size_t hardlinks = 0;
+  // directories skipped because their inode had already been walked (symlinks, bind mounts)
+  size_t directories = 0;
+  // files whose result was taken from an earlier file with the same content fingerprint
+  size_t duplicates = 0;
+  // bytes of those files that did not have to be scanned
+  std::uint64_t duplicate_bytes = 0;
+};
 
 class FileInfoCollector {
  public:
   void Add(const FileInfo& fileinfo);
   std::vector<std::pair<int, FileInfo>> Summarize() const;
+  void AddMember(const MemberInfo& member);
+  std::vector<std::pair<int, MemberInfo>> SummarizeMembers() const;
+  ScanStats Stats() const;
+
+  // Returns false if the directory has been visited before
+  bool VisitDirectory(const FileId& id);
+
+  // Detects content of an inode with several hard links once, later links reuse the result
+  // Second is false for the links that reused it
+  std::pair<FileInfo, bool> DetectInode(const FileId& id, const std::function<FileInfo()>& detect);
+
+  // Same for files with equal content fingerprint
+  std::pair<FileInfo, bool> DetectContent(const Fingerprint& fp, const std::function<FileInfo()>& detect);
 
  private:
   mutable std::mutex mutex;
   std::unordered_map<FileInfo, int> mp;
+  std::unordered_map<MemberInfo, int> members;
+
+  ConcurrentSet<FileId> directories;
+  ConcurrentMemo<FileId, FileInfo> inodes;
+  ConcurrentMemo<Fingerprint, FileInfo> contents;
+  std::atomic<size_t> hardlinks = 0;
+  std::atomic<size_t> skipped_directories = 0;
+  std::atomic<size_t> duplicates = 0;
+  std::atomic<std::uint64_t> duplicate_bytes = 0;
 };
 
+// Prints a result followed by the per-file details that the summary leaves out
+struct Detailed {
+  const FileInfo& info;
+};
+
+// The result without the details that identify a single file, e.g. the needed libraries of an ELF binary.
+// Files with equal keys share an entry of the summary
+FileInfo summary_key(const FileInfo& info);
+
 FileInfo detect_content(scnr::StreamData stream);
-void process(const std::filesystem::path& path, FileInfoCollector& collector);
+// Also looks into containers up to options.max_depth, members are reported to the sink
+FileInfo detect_content(scnr::StreamData stream, const ContainerOptions& options, const MemberSink& sink,
+                        size_t depth = 0);
+// The detectors of formats with a magic number only, without the data, script, XML and text checks that may read
+// the whole stream; members and compressed content are detected in full
+FileInfo detect_magic(scnr::StreamData stream, const ContainerOptions& options, const MemberSink& sink,
+                      size_t depth = 0);
+// Looks for the magic numbers of known formats at every offset past 0 and returns what detect_magic identifies
+// there, by offset
+std::vector<EmbeddedFile> find_embedded(scnr::StreamData stream, const ContainerOptions& options = {},
+                                        const MemberSink& sink = {});
+void process(const std::filesystem::path& path, FileInfoCollector& collector, const ScanOptions& options = {});
 
 }  // namespace scnr
 
@@ -42,4 +263,64 @@ inline std::ostream& operator<<(std::ostream& os, const scnr::FileInfo& info) {
     },
     info);
   return os;
-}
\ No newline at end of file
+}
+
+namespace scnr {
+
+// Details of the decompressed content
+inline void print_details(std::ostream& os, const CompressedFile& file);
+
+// The per-file details part of Detailed
+inline void print_file_details(std::ostream& os, const FileInfo& info) {
+  std::visit(
+    [&](auto&& arg) {
+      if constexpr (requires { arg.details; }) {
+        os << ", " << arg.details;
+      } else if constexpr (requires { scnr::print_details(os, arg); }) {
+        scnr::print_details(os, arg);
+      }
+    },
+    info);
+}
+
+}  // namespace scnr
+
+inline std::ostream& operator<<(std::ostream& os, scnr::Detailed detailed) {
+  os << detailed.info;
+  scnr::print_file_details(os, detailed.info);
+  return os;
+}
+
+namespace scnr {
+
+inline bool CompressedFile::operator==(const CompressedFile& rhs) const noexcept {
+  if (format != rhs.format || !content != !rhs.content) {
+    return false;
+  }
+  return !content || content->info == rhs.content->info;
+}
+
+inline std::ostream& operator<<(std::ostream& os, const CompressedFile& file) {
+  os << "compressed = [" << file.format << "]";
+  if (file.content) {
+    // the FileInfo printer is global, it is hidden by the printers of this namespace
+    ::operator<<(os << " -> ", file.content->info);
+  }
+  return os;
+}
+
+inline void print_details(std::ostream& os, const CompressedFile& file) {
+  if (file.content) {
+    print_file_details(os, file.content->info);
+  }
+}
+
+}  // namespace scnr
+
+inline std::size_t std::hash<scnr::CompressedFile>::operator()(const scnr::CompressedFile& compressed) const noexcept {
+  std::uint64_t ret = std::hash<std::string_view>{}(compressed.format);
+  if (compressed.content) {
+    scnr::hash_combine(ret, std::hash<scnr::FileInfo>{}(compressed.content->info));
+  }
+  return ret;
+}
@@ -31,6 +31,9 @@ class ThreadPool {
   // Pending tasks will be discarded
   void Stop();
 
+  // Number of worker threads
+  size_t Workers() const;
+
   // Locates current thread pool from worker thread
   static ThreadPool* Current();
 
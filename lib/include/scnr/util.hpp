@@ -104,6 +104,65 @@ inline void trim_right(std::string& str) {
   }
 }
 
+// Byte buffer that stays on the stack up to N bytes
+template <size_t N>
+class SmallBuffer {
+ public:
+  explicit SmallBuffer(size_t size) : size_(size) {
+    if (size_ > N) {
+      heap_.resize(size_);
+    }
+  }
+
+  SmallBuffer(const SmallBuffer&) = delete;
+  SmallBuffer& operator=(const SmallBuffer&) = delete;
+
+  Byte* data() {
+    return size_ > N ? heap_.data() : stack_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+ private:
+  size_t size_ = 0;
+  Byte stack_[N];
+  std::vector<Byte> heap_;
+};
+
+// Reads NUL-terminated strings at the given stream offsets. Names of a string table usually lie close
+// together, they come with a single read of at most max_span bytes; the rest are read one by one.
+// Strings without a terminator within max_length bytes are returned empty
+inline std::vector<std::string> read_cstrings(StreamData stream, const std::vector<uint64_t>& offsets,
+                                              size_t max_length = 1024, size_t max_span = 64 * 1024) {
+  std::vector<std::string> retval(offsets.size());
+  if (offsets.empty()) {
+    return retval;
+  }
+  auto [lo, hi] = std::minmax_element(offsets.begin(), offsets.end());
+  SmallBuffer<4096> span(std::min<uint64_t>(std::min<uint64_t>(*hi - *lo, max_span) + max_length, max_span));
+  const size_t span_size = stream.readsome(span.data(), *lo, span.size());
+
+  std::vector<Byte> buf;
+  for (size_t i = 0; i < offsets.size(); ++i) {
+    const char* begin = nullptr;
+    size_t avail = 0;
+    if (offsets[i] - *lo < span_size) {
+      begin = reinterpret_cast<const char*>(span.data()) + (offsets[i] - *lo);
+      avail = span_size - (offsets[i] - *lo);
+    } else {
+      buf.resize(max_length);
+      begin = reinterpret_cast<const char*>(buf.data());
+      avail = stream.readsome(buf.data(), offsets[i], max_length);
+    }
+    if (auto end = static_cast<const char*>(std::memchr(begin, '\0', std::min(avail, max_length)))) {
+      retval[i].assign(begin, end);
+    }
+  }
+  return retval;
+}
+
 // poor man's hash_combine
 inline void hash_combine(std::uint64_t& seed, std::uint64_t hash) {
   seed ^= hash + 0x9e3779b9 + (seed << 6) + (seed >> 2);
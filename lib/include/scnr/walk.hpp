@@ -0,0 +1,78 @@
+#pragma once
+
+#include <scnr/util.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+namespace scnr {
+
+enum class EntryType {
+  kUnknown,
+  kRegular,
+  kDirectory,
+  kSymlink,
+  kOther,
+};
+
+enum class FileOrder {
+  // as returned by readdir, hash order on ext4/XFS
+  kDirectory,
+  // by d_ino, free to compute and close to the on-disk layout
+  kInode,
+  // by physical offset of the first extent (FIEMAP), falls back to inode order where not supported
+  kExtent,
+};
+
+struct DirEntry {
+  std::filesystem::path path;
+  // d_ino as reported by readdir, 0 where the platform does not expose it
+  std::uint64_t ino = 0;
+  // d_type as reported by readdir, symlinks are not resolved
+  EntryType type = EntryType::kUnknown;
+};
+
+// Identifies the inode behind a path
+struct FileId {
+  std::uint64_t dev = 0;
+  std::uint64_t ino = 0;
+
+  bool operator==(const FileId& rhs) const noexcept {
+    return dev == rhs.dev && ino == rhs.ino;
+  }
+};
+
+struct FileStatus {
+  FileId id;
+  std::uint64_t nlink = 0;
+  std::uint64_t size = 0;
+};
+
+// stat(2) of the path, symlinks are followed. On Windows the volume serial number and the file index stand in for
+// the device and the inode
+// Returns nullopt on failure
+std::optional<FileStatus> stat_file(const std::filesystem::path& path);
+
+// lstat(2) or stat(2) of the path, kUnknown if it does not exist
+EntryType entry_type(const std::filesystem::path& path, bool follow_symlinks);
+
+// Reads all entries of the directory in readdir order, '.' and '..' are skipped
+// Throws std::filesystem::filesystem_error if the directory could not be opened
+std::vector<DirEntry> list_directory(const std::filesystem::path& path);
+
+// Reorders a batch of files to minimize seeks when they are read one after another
+void order_files(std::vector<DirEntry>& files, FileOrder order);
+
+}  // namespace scnr
+
+template <>
+struct std::hash<scnr::FileId> {
+  inline std::size_t operator()(const scnr::FileId& id) const noexcept {
+    std::uint64_t ret = 0;
+    scnr::hash_combine(ret, std::hash<std::uint64_t>{}(id.dev));
+    scnr::hash_combine(ret, std::hash<std::uint64_t>{}(id.ino));
+    return ret;
+  }
+};
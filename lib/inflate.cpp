@@ -0,0 +1,360 @@
+#include <scnr/inflate.hpp>
+
+#include <algorithm>
+#include <cstdint>
+
+namespace {
+
+constexpr size_t kWindowSize = 32 * 1024;
+constexpr int kMaxBits = 15;
+constexpr int kMaxLengthCodes = 286;
+constexpr int kMaxDistCodes = 30;
+constexpr int kFixedLengthCodes = 288;
+// InflatingStream grows its data at least by that much
+constexpr size_t kMinInflateChunk = 16 * 1024;
+
+constexpr std::uint16_t kLengthBase[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                           31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+constexpr std::uint8_t kLengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                           2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr std::uint16_t kDistBase[30] = {1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+                                         33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+                                         1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+constexpr std::uint8_t kDistExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+                                         6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+// order of the code length code lengths in a dynamic block header
+constexpr std::uint8_t kCodeLengthOrder[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+// Canonical Huffman code from code lengths. Returns 0 for a complete code, a positive number for an incomplete
+// one and a negative number for an over-subscribed one
+int build(scnr::Inflater::Huffman& huffman, const std::uint8_t* lengths, int n) {
+  std::fill(std::begin(huffman.count), std::end(huffman.count), 0);
+  for (int symbol = 0; symbol < n; ++symbol) {
+    huffman.count[lengths[symbol]] += 1;
+  }
+  if (huffman.count[0] == n) {
+    return 0;
+  }
+  int left = 1;
+  for (int len = 1; len <= kMaxBits; ++len) {
+    left <<= 1;
+    left -= huffman.count[len];
+    if (left < 0) {
+      return left;
+    }
+  }
+  std::uint16_t offsets[kMaxBits + 1];
+  offsets[1] = 0;
+  for (int len = 1; len < kMaxBits; ++len) {
+    offsets[len + 1] = offsets[len] + huffman.count[len];
+  }
+  for (int symbol = 0; symbol < n; ++symbol) {
+    if (lengths[symbol] != 0) {
+      huffman.symbol[offsets[lengths[symbol]]++] = symbol;
+    }
+  }
+  return left;
+}
+
+struct FixedCodes {
+  scnr::Inflater::Huffman lencode;
+  scnr::Inflater::Huffman distcode;
+
+  FixedCodes() {
+    std::uint8_t lengths[kFixedLengthCodes];
+    std::fill(lengths, lengths + 144, 8);
+    std::fill(lengths + 144, lengths + 256, 9);
+    std::fill(lengths + 256, lengths + 280, 7);
+    std::fill(lengths + 280, lengths + kFixedLengthCodes, 8);
+    build(lencode, lengths, kFixedLengthCodes);
+    std::fill(lengths, lengths + kMaxDistCodes, 5);
+    build(distcode, lengths, kMaxDistCodes);
+  }
+};
+
+}  // namespace
+
+namespace scnr {
+
+Inflater::Inflater(StreamData input) : input_(input), window_(kWindowSize) {
+}
+
+bool Inflater::Fill() {
+  input_.poll();
+  in_len_ = input_.readsome(in_buf_, in_pos_, sizeof(in_buf_));
+  in_pos_ += in_len_;
+  in_idx_ = 0;
+  return in_len_ > 0;
+}
+
+bool Inflater::Bits(int n, std::uint32_t& value) {
+  while (bitcnt_ < n) {
+    if (in_idx_ == in_len_ && !Fill()) {
+      return false;
+    }
+    bitbuf_ |= std::uint64_t{in_buf_[in_idx_++]} << bitcnt_;
+    bitcnt_ += 8;
+  }
+  value = static_cast<std::uint32_t>(bitbuf_ & ((std::uint64_t{1} << n) - 1));
+  bitbuf_ >>= n;
+  bitcnt_ -= n;
+  return true;
+}
+
+// Huffman codes are stored most significant bit first, unlike everything else
+int Inflater::Decode(const Huffman& huffman) {
+  int code = 0;
+  int first = 0;
+  int index = 0;
+  for (int len = 1; len <= kMaxBits; ++len) {
+    std::uint32_t bit;
+    if (!Bits(1, bit)) {
+      return -1;
+    }
+    code |= bit;
+    const int count = huffman.count[len];
+    if (code - count < first) {
+      return huffman.symbol[index + (code - first)];
+    }
+    index += count;
+    first += count;
+    first <<= 1;
+    code <<= 1;
+  }
+  return -1;
+}
+
+bool Inflater::ReadDynamicTables() {
+  std::uint32_t nlen, ndist, ncode;
+  if (!Bits(5, nlen) || !Bits(5, ndist) || !Bits(4, ncode)) {
+    return false;
+  }
+  nlen += 257;
+  ndist += 1;
+  ncode += 4;
+  if (nlen > kMaxLengthCodes || ndist > kMaxDistCodes) {
+    return false;
+  }
+
+  std::uint8_t lengths[kMaxLengthCodes + kMaxDistCodes] = {};
+  for (std::uint32_t i = 0; i < ncode; ++i) {
+    std::uint32_t len;
+    if (!Bits(3, len)) {
+      return false;
+    }
+    lengths[kCodeLengthOrder[i]] = len;
+  }
+  Huffman clcode;
+  if (build(clcode, lengths, 19) != 0) {
+    return false;
+  }
+
+  std::uint32_t index = 0;
+  while (index < nlen + ndist) {
+    int symbol = Decode(clcode);
+    if (symbol < 0) {
+      return false;
+    }
+    if (symbol < 16) {
+      lengths[index++] = symbol;
+      continue;
+    }
+    std::uint8_t len = 0;
+    std::uint32_t repeat;
+    if (symbol == 16) {
+      if (index == 0 || !Bits(2, repeat)) {
+        return false;
+      }
+      len = lengths[index - 1];
+      repeat += 3;
+    } else if (symbol == 17) {
+      if (!Bits(3, repeat)) {
+        return false;
+      }
+      repeat += 3;
+    } else {
+      if (!Bits(7, repeat)) {
+        return false;
+      }
+      repeat += 11;
+    }
+    if (index + repeat > nlen + ndist) {
+      return false;
+    }
+    std::fill(lengths + index, lengths + index + repeat, len);
+    index += repeat;
+  }
+
+  // a block without end-of-block code can not end
+  if (lengths[256] == 0) {
+    return false;
+  }
+  // incomplete codes are only allowed for a single code
+  int err = build(lencode_, lengths, nlen);
+  if (err < 0 || (err > 0 && nlen - lencode_.count[0] != 1)) {
+    return false;
+  }
+  err = build(distcode_, lengths + nlen, ndist);
+  if (err < 0 || (err > 0 && ndist - distcode_.count[0] != 1)) {
+    return false;
+  }
+  return true;
+}
+
+bool Inflater::ReadHeader() {
+  std::uint32_t last, type;
+  if (!Bits(1, last) || !Bits(2, type)) {
+    return false;
+  }
+  last_ = last;
+  switch (type) {
+    case 0: {
+      // stored blocks start at a byte boundary
+      bitbuf_ >>= bitcnt_ % 8;
+      bitcnt_ -= bitcnt_ % 8;
+      std::uint32_t len, nlen;
+      if (!Bits(16, len) || !Bits(16, nlen) || len != (~nlen & 0xffff)) {
+        return false;
+      }
+      stored_left_ = len;
+      state_ = State::kStored;
+      return true;
+    }
+    case 1: {
+      static const FixedCodes fixed;
+      lencode_ = fixed.lencode;
+      distcode_ = fixed.distcode;
+      state_ = State::kHuffman;
+      return true;
+    }
+    case 2:
+      state_ = State::kHuffman;
+      return ReadDynamicTables();
+    default:
+      return false;
+  }
+}
+
+void Inflater::Emit(Byte b, Byte* dst, size_t& produced) {
+  window_[wpos_ % kWindowSize] = b;
+  wpos_ += 1;
+  dst[produced++] = b;
+}
+
+size_t Inflater::Read(Byte* dst, size_t count) {
+  size_t produced = 0;
+  while (produced < count) {
+    if (copy_left_ > 0) {
+      const size_t n = std::min(copy_left_, count - produced);
+      for (size_t i = 0; i < n; ++i) {
+        Emit(window_[(wpos_ - copy_dist_) % kWindowSize], dst, produced);
+      }
+      copy_left_ -= n;
+      continue;
+    }
+
+    switch (state_) {
+      case State::kDone:
+      case State::kError:
+        return produced;
+      case State::kHeader:
+        if (!ReadHeader()) {
+          state_ = State::kError;
+        }
+        break;
+      case State::kStored: {
+        if (stored_left_ == 0) {
+          state_ = last_ ? State::kDone : State::kHeader;
+          break;
+        }
+        std::uint32_t b;
+        if (!Bits(8, b)) {
+          state_ = State::kError;
+          break;
+        }
+        Emit(b, dst, produced);
+        stored_left_ -= 1;
+        break;
+      }
+      case State::kHuffman: {
+        const int symbol = Decode(lencode_);
+        if (symbol < 0) {
+          state_ = State::kError;
+        } else if (symbol < 256) {
+          Emit(symbol, dst, produced);
+        } else if (symbol == 256) {
+          state_ = last_ ? State::kDone : State::kHeader;
+        } else {
+          const int index = symbol - 257;
+          std::uint32_t extra_len, extra_dist;
+          if (index >= 29 || !Bits(kLengthExtra[index], extra_len)) {
+            state_ = State::kError;
+            break;
+          }
+          const int dist_symbol = Decode(distcode_);
+          if (dist_symbol < 0 || dist_symbol >= kMaxDistCodes || !Bits(kDistExtra[dist_symbol], extra_dist)) {
+            state_ = State::kError;
+            break;
+          }
+          const size_t dist = kDistBase[dist_symbol] + extra_dist;
+          if (dist > wpos_ || dist > kWindowSize) {
+            state_ = State::kError;
+            break;
+          }
+          copy_dist_ = dist;
+          copy_left_ = kLengthBase[index] + extra_len;
+        }
+        break;
+      }
+    }
+  }
+  return produced;
+}
+
+void InflatingStream::Buffer::Extend(size_t size) {
+  size = std::min(size, cap_);
+  const size_t pos = gptr() - eback();
+  while (data_.size() < size && !inflater_.Finished() && !inflater_.Failed()) {
+    const size_t old_size = data_.size();
+    data_.resize(std::min(std::max({size, old_size * 2, kMinInflateChunk}), cap_));
+    const size_t n = inflater_.Read(reinterpret_cast<Byte*>(data_.data() + old_size), data_.size() - old_size);
+    data_.resize(old_size + n);
+    if (n == 0) {
+      break;
+    }
+  }
+  setg(data_.data(), data_.data() + pos, data_.data() + data_.size());
+}
+
+InflatingStream::Buffer::int_type InflatingStream::Buffer::underflow() {
+  if (gptr() == egptr()) {
+    Extend(data_.size() + 1);
+  }
+  return gptr() == egptr() ? traits_type::eof() : traits_type::to_int_type(*gptr());
+}
+
+InflatingStream::Buffer::pos_type InflatingStream::Buffer::seekoff(off_type off, std::ios_base::seekdir dir,
+                                                                   std::ios_base::openmode which) {
+  if (dir == std::ios_base::cur) {
+    off += gptr() - eback();
+  } else if (dir == std::ios_base::end) {
+    Extend(cap_);
+    off += data_.size();
+  }
+  return seekpos(off, which);
+}
+
+InflatingStream::Buffer::pos_type InflatingStream::Buffer::seekpos(pos_type pos, std::ios_base::openmode which) {
+  const off_type target = pos;
+  if (!(which & std::ios_base::in) || target < 0) {
+    return pos_type(off_type(-1));
+  }
+  Extend(target);
+  if (static_cast<size_t>(target) > data_.size()) {
+    return pos_type(off_type(-1));
+  }
+  setg(data_.data(), data_.data() + target, data_.data() + data_.size());
+  return pos;
+}
+
+}  // namespace scnr
@@ -0,0 +1,289 @@
+#include <scnr/parse_archive.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string_view>
+
+namespace {
+
+constexpr std::string_view kArMagic = "!<arch>\n";
+// members of thin archives stay in their own files, only the headers are in the archive
+constexpr std::string_view kArThinMagic = "!<thin>\n";
+
+struct ArHeader {
+  char name[16];
+  char date[12];
+  char uid[6];
+  char gid[6];
+  char mode[8];
+  char size[10];
+  char fmag[2];
+};
+static_assert(sizeof(ArHeader) == 60);
+
+// BSD ar keeps long names in front of the member data, "#1/<length>" in the header
+constexpr std::string_view kBsdLongName = "#1/";
+// Symbol tables are not members: "/" and "/SYM64/" in GNU archives, "__.SYMDEF" and "__.SYMDEF SORTED" in BSD
+// archives; "//" is the GNU long name table
+constexpr std::string_view kBsdSymbolTable = "__.SYMDEF";
+
+constexpr size_t kTarBlock = 512;
+constexpr size_t kTarSizeOffset = 124;
+constexpr size_t kTarSizeLength = 12;
+constexpr size_t kTarChecksumOffset = 148;
+constexpr size_t kTarChecksumLength = 8;
+constexpr size_t kTarTypeOffset = 156;
+constexpr size_t kTarMagicOffset = 257;
+// both "ustar\0" (POSIX) and "ustar  " (GNU)
+constexpr std::string_view kTarMagic = "ustar";
+// Pax records of interest are short, the rest of a larger extended header is not read
+constexpr size_t kMaxPaxHeader = 4 * 1024;
+// No real member comes close, larger values are corrupt and would overflow the block arithmetic
+constexpr uint64_t kMaxMemberSize = uint64_t{1} << 56;
+
+// Space padded decimal field of an ar header
+std::optional<uint64_t> parse_decimal(std::string_view field) {
+  uint64_t retval = 0;
+  size_t i = 0;
+  for (; i < field.size() && field[i] >= '0' && field[i] <= '9'; ++i) {
+    retval = retval * 10 + (field[i] - '0');
+  }
+  if (i == 0 || i > 19) {
+    return {};
+  }
+  for (; i < field.size(); ++i) {
+    if (field[i] != ' ') {
+      return {};
+    }
+  }
+  return retval;
+}
+
+// Octal tar field with optional leading spaces, terminated by a space or NUL; GNU tar stores values that do not
+// fit as big-endian base-256 with the high bit of the first byte set
+std::optional<uint64_t> parse_tar_number(const scnr::Byte* field, size_t size) {
+  if (field[0] & 0x80) {
+    uint64_t retval = field[0] & 0x7f;
+    for (size_t i = 1; i < size; ++i) {
+      if (retval >> 56) {
+        return {};
+      }
+      retval = (retval << 8) | field[i];
+    }
+    return retval;
+  }
+  uint64_t retval = 0;
+  size_t i = 0;
+  while (i < size && field[i] == ' ') {
+    ++i;
+  }
+  const size_t first = i;
+  for (; i < size && field[i] >= '0' && field[i] <= '7'; ++i) {
+    if (retval >> 60) {
+      return {};
+    }
+    retval = retval * 8 + (field[i] - '0');
+  }
+  if (i == first || (i < size && field[i] != ' ' && field[i] != '\0')) {
+    return {};
+  }
+  return retval;
+}
+
+// The checksum is the sum of all header bytes with the checksum field taken as spaces, some old tars summed
+// signed chars
+bool is_tar_header(const scnr::Byte* block) {
+  auto stored = parse_tar_number(block + kTarChecksumOffset, kTarChecksumLength);
+  if (!stored) {
+    return false;
+  }
+  uint64_t unsigned_sum = 0;
+  int64_t signed_sum = 0;
+  for (size_t i = 0; i < kTarBlock; ++i) {
+    const bool checksum = i >= kTarChecksumOffset && i < kTarChecksumOffset + kTarChecksumLength;
+    const scnr::Byte b = checksum ? ' ' : block[i];
+    unsigned_sum += b;
+    signed_sum += static_cast<signed char>(b);
+  }
+  if (stored.value() != unsigned_sum && static_cast<int64_t>(stored.value()) != signed_sum) {
+    return false;
+  }
+  // v7 headers have no magic, an empty name is never valid
+  return std::memcmp(block + kTarMagicOffset, kTarMagic.data(), kTarMagic.size()) == 0 || block[0] != '\0';
+}
+
+// Value of the "size" record of a pax extended header, records are "<length> <key>=<value>\n"
+std::optional<uint64_t> pax_size(scnr::StreamData stream, uint64_t offset, uint64_t size) {
+  char buf[kMaxPaxHeader];
+  const size_t nbytes =
+    stream.readsome(reinterpret_cast<scnr::Byte*>(buf), offset, std::min<uint64_t>(size, sizeof(buf)));
+  std::string_view records(buf, nbytes);
+  while (!records.empty()) {
+    auto space = records.find(' ');
+    if (space == std::string_view::npos) {
+      break;
+    }
+    auto length = parse_decimal(records.substr(0, space));
+    if (!length || length.value() <= space + 1 || length.value() > records.size()) {
+      break;
+    }
+    auto record = records.substr(space + 1, length.value() - space - 2);
+    if (record.substr(0, 5) == "size=") {
+      return parse_decimal(record.substr(5));
+    }
+    records.remove_prefix(length.value());
+  }
+  return {};
+}
+
+std::optional<scnr::ArchiveFile> try_ar(scnr::StreamData stream, const scnr::MemberVisitor& visit) {
+  char magic[kArMagic.size()];
+  if (!stream.read(magic, 0, sizeof(magic))) {
+    return {};
+  }
+  const std::string_view sv(magic, sizeof(magic));
+  if (sv != kArMagic && sv != kArThinMagic) {
+    return {};
+  }
+  scnr::ArchiveFile retval{.format = "ar"};
+  if (!visit || sv == kArThinMagic) {
+    return retval;
+  }
+
+  // the header comes with the start of the data, enough to see a BSD long name
+  char buf[sizeof(ArHeader) + kBsdSymbolTable.size()];
+  ArHeader header;
+  uint64_t offset = kArMagic.size();
+  while (true) {
+    stream.poll();
+    const size_t nbytes = stream.readsome(reinterpret_cast<scnr::Byte*>(buf), offset, sizeof(buf));
+    if (nbytes < sizeof(header)) {
+      break;
+    }
+    std::memcpy(&header, buf, sizeof(header));
+    auto size = parse_decimal(std::string_view(header.size, sizeof(header.size)));
+    if (std::memcmp(header.fmag, "`\n", sizeof(header.fmag)) != 0 || !size) {
+      break;
+    }
+
+    const std::string_view name(header.name, sizeof(header.name));
+    uint64_t data = offset + sizeof(header);
+    uint64_t data_size = size.value();
+    bool member = name[0] != '/' || (name[1] != ' ' && name[1] != '/' && name.substr(0, 7) != "/SYM64/");
+    if (name.substr(0, kBsdLongName.size()) == kBsdLongName) {
+      auto length = parse_decimal(name.substr(kBsdLongName.size()));
+      if (!length || length.value() > data_size) {
+        break;
+      }
+      auto long_name = std::string_view(buf + sizeof(header), nbytes - sizeof(header)).substr(0, length.value());
+      member = long_name.substr(0, kBsdSymbolTable.size()) != kBsdSymbolTable;
+      data += length.value();
+      data_size -= length.value();
+    } else if (name.substr(0, kBsdSymbolTable.size()) == kBsdSymbolTable) {
+      member = false;
+    }
+
+    if (member) {
+      if (!visit(stream.sliced(data, data_size))) {
+        retval.details.truncated = true;
+        break;
+      }
+      retval.details.members += 1;
+    }
+    // members are 2-byte aligned, a BSD long name counts to the member size
+    offset += sizeof(header) + size.value() + (size.value() & 1);
+  }
+  return retval;
+}
+
+// Walks the headers up to the end-of-archive blocks and returns the offset past the archive; a visitor that
+// stops the iteration marks the details truncated
+uint64_t walk_tar(scnr::StreamData stream, const scnr::MemberVisitor& visit, scnr::ArchiveDetails& details) {
+  scnr::Byte block[kTarBlock];
+  std::optional<uint64_t> next_size;
+  uint64_t offset = 0;
+  while (stream.read(block, offset, sizeof(block))) {
+    stream.poll();
+    // the archive ends with two zero blocks
+    if (std::all_of(block, block + sizeof(block), [](auto b) {
+          return b == 0;
+        })) {
+      return offset + 2 * kTarBlock;
+    }
+    auto size = parse_tar_number(block + kTarSizeOffset, kTarSizeLength);
+    if (!is_tar_header(block) || !size || size.value() > kMaxMemberSize) {
+      break;
+    }
+
+    const uint64_t data = offset + sizeof(block);
+    switch (block[kTarTypeOffset]) {
+      case 'x':
+        // pax header of the next entry, it may carry a size that does not fit the header field
+        next_size = pax_size(stream, data, size.value());
+        break;
+      case 'g':
+      case 'L':
+      case 'K':
+        // global pax header and GNU long names, the next header is still the entry
+        break;
+      case '0':
+      case '\0':
+      case '7':
+        size = std::min(next_size.value_or(size.value()), kMaxMemberSize);
+        next_size.reset();
+        if (visit) {
+          if (!visit(stream.sliced(data, size.value()))) {
+            details.truncated = true;
+            return data;
+          }
+          details.members += 1;
+        }
+        break;
+      default:
+        // directories, links, devices, GNU sparse files
+        next_size.reset();
+        break;
+    }
+    offset = data + (size.value() + kTarBlock - 1) / kTarBlock * kTarBlock;
+  }
+  return offset;
+}
+
+std::optional<scnr::ArchiveFile> try_tar(scnr::StreamData stream, const scnr::MemberVisitor& visit) {
+  scnr::Byte block[kTarBlock];
+  if (!stream.read(block, 0, sizeof(block)) || !is_tar_header(block)) {
+    return {};
+  }
+  scnr::ArchiveFile retval{.format = "tar"};
+  if (visit) {
+    walk_tar(stream, visit, retval.details);
+  }
+  return retval;
+}
+
+}  // namespace
+
+namespace scnr {
+
+std::optional<ArchiveFile> try_archive(scnr::StreamData stream, const MemberVisitor& visit) {
+  if (auto zip = try_zip(stream, visit)) {
+    return zip;
+  }
+  if (auto ar = try_ar(stream, visit)) {
+    return ar;
+  }
+  return try_tar(stream, visit);
+}
+
+std::optional<std::uint64_t> tar_size(scnr::StreamData stream) {
+  Byte block[kTarBlock];
+  if (!stream.read(block, 0, sizeof(block)) || !is_tar_header(block)) {
+    return {};
+  }
+  ArchiveDetails details;
+  return walk_tar(stream, {}, details);
+}
+
+}  // namespace scnr
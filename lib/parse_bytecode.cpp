@@ -0,0 +1,459 @@
+#include <scnr/parse_bytecode.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+constexpr std::string_view kWasmMagic{"\0asm", 4};
+constexpr size_t kWasmHeaderSize = 8;
+// section ids of core modules go up to the data count section
+constexpr scnr::Byte kWasmMaxSectionId = 12;
+
+constexpr std::uint32_t kJavaMagic = 0xcafebabe;
+constexpr size_t kJavaHeaderSize = 10;
+// 45 is JDK 1.0.2; the upper bound leaves room for decades of releases. Mach-O fat binaries share the magic,
+// their architecture count takes the place of the version and is far lower
+constexpr std::uint16_t kJavaMinMajor = 45;
+constexpr std::uint16_t kJavaMaxMajor = 100;
+
+constexpr std::string_view kDexMagic = "dex\n";
+constexpr std::string_view kCompactDexMagic = "cdex";
+constexpr size_t kDexEndianTagOffset = 0x28;
+constexpr std::uint32_t kDexEndianConstant = 0x12345678;
+
+constexpr std::string_view kBitcodeMagic = "BC\xc0\xde";
+constexpr std::uint32_t kBitcodeWrapperMagic = 0x0b17c0de;
+constexpr size_t kBitcodeWrapperSize = 20;
+// The identification block and the module records up to the triple; every other block is skipped by its length
+constexpr size_t kMaxBitcodeReads = 32;
+constexpr size_t kMaxBitcodeBytes = 128 * 1024;
+constexpr size_t kMaxBitcodeEntries = 4096;
+constexpr size_t kMaxBitcodeString = 256;
+
+// Block and record ids of the LLVM bitstream, see llvm/Bitstream/BitCodeEnums.h and LLVMBitCodes.h
+enum BitcodeAbbrevId : std::uint32_t {
+  kEndBlock = 0,
+  kEnterSubblock = 1,
+  kDefineAbbrev = 2,
+  kUnabbrevRecord = 3,
+  kFirstApplicationAbbrev = 4,
+};
+constexpr std::uint64_t kModuleBlockId = 8;
+constexpr std::uint64_t kIdentificationBlockId = 13;
+constexpr std::uint64_t kModuleCodeTriple = 2;
+constexpr std::uint64_t kIdentificationCodeString = 1;
+
+template <typename T>
+T get_le(const scnr::Byte* p) {
+  T value;
+  std::memcpy(&value, p, sizeof(value));
+  return scnr::LEToHost(value);
+}
+
+template <typename T>
+T get_be(const scnr::Byte* p) {
+  T value;
+  std::memcpy(&value, p, sizeof(value));
+  return scnr::BEToHost(value);
+}
+
+// Bits of the stream least significant first, the order of the 32-bit little endian words of bitcode
+class BitReader {
+ public:
+  explicit BitReader(scnr::StreamData stream) : stream_(stream) {
+  }
+
+  bool Fixed(int n, std::uint64_t& value) {
+    if (n > 32) {
+      return false;
+    }
+    while (bitcnt_ < n) {
+      if (in_idx_ == in_len_ && !Fill()) {
+        return false;
+      }
+      bitbuf_ |= std::uint64_t{in_buf_[in_idx_++]} << bitcnt_;
+      bitcnt_ += 8;
+    }
+    value = bitbuf_ & ((std::uint64_t{1} << n) - 1);
+    bitbuf_ >>= n;
+    bitcnt_ -= n;
+    return true;
+  }
+
+  // Chunks of n - 1 bits, the high bit of a chunk tells that another one follows
+  bool Vbr(int n, std::uint64_t& value) {
+    if (n < 2) {
+      return false;
+    }
+    value = 0;
+    for (int shift = 0; shift < 64; shift += n - 1) {
+      std::uint64_t chunk;
+      if (!Fixed(n, chunk)) {
+        return false;
+      }
+      const std::uint64_t hibit = std::uint64_t{1} << (n - 1);
+      value |= (chunk & (hibit - 1)) << shift;
+      if (!(chunk & hibit)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool Align32() {
+    const std::uint64_t pos = (buf_start_ + in_idx_) * 8 - bitcnt_;
+    return Jump((pos + 31) / 32 * 4);
+  }
+
+  bool SkipWords(std::uint64_t words) {
+    const std::uint64_t pos = buf_start_ + in_idx_ - bitcnt_ / 8;
+    return bitcnt_ % 8 == 0 && Jump(pos + words * 4);
+  }
+
+ private:
+  bool Fill() {
+    stream_.poll();
+    buf_start_ += in_len_;
+    in_len_ = stream_.readsome(in_buf_, buf_start_, sizeof(in_buf_));
+    in_idx_ = 0;
+    return in_len_ > 0;
+  }
+
+  // Continues at a byte offset, without reading when it is in the buffer
+  bool Jump(std::uint64_t offset) {
+    bitbuf_ = 0;
+    bitcnt_ = 0;
+    if (offset >= buf_start_ && offset <= buf_start_ + in_len_) {
+      in_idx_ = offset - buf_start_;
+    } else {
+      buf_start_ = offset;
+      in_len_ = 0;
+      in_idx_ = 0;
+    }
+    return true;
+  }
+
+  scnr::StreamData stream_;
+  scnr::Byte in_buf_[4096];
+  std::uint64_t buf_start_ = 0;
+  size_t in_len_ = 0;
+  size_t in_idx_ = 0;
+  std::uint64_t bitbuf_ = 0;
+  int bitcnt_ = 0;
+};
+
+struct AbbrevOp {
+  enum class Encoding : std::uint8_t { kLiteral = 0, kFixed = 1, kVbr = 2, kArray = 3, kChar6 = 4, kBlob = 5 };
+  Encoding encoding = Encoding::kLiteral;
+  std::uint64_t value = 0;
+};
+using Abbrev = std::vector<AbbrevOp>;
+
+char decode_char6(std::uint64_t value) {
+  constexpr std::string_view kChars = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789._";
+  return kChars[value & 63];
+}
+
+// Record of a block: its code and operands, strings are short and longer operand lists are cut
+struct Record {
+  std::uint64_t code = 0;
+  std::vector<std::uint64_t> ops;
+
+  void Add(std::uint64_t op) {
+    if (ops.size() < kMaxBitcodeString) {
+      ops.push_back(op);
+    }
+  }
+
+  std::string AsString() const {
+    return std::string(ops.begin(), ops.end());
+  }
+};
+
+class BitcodeParser {
+ public:
+  explicit BitcodeParser(scnr::StreamData stream) : reader_(stream) {
+  }
+
+  // Walks the top level blocks until the module block has been read up to its triple. A corrupt or cut module
+  // is still bitcode, it just has no triple
+  void Parse(scnr::BitcodeFile& bitcode) {
+    while (entries_++ < kMaxBitcodeEntries) {
+      std::uint64_t abbrev_id, block_id;
+      if (!reader_.Fixed(2, abbrev_id) || abbrev_id != kEnterSubblock || !reader_.Vbr(8, block_id)) {
+        return;
+      }
+      if (block_id == kModuleBlockId) {
+        ParseBlock(block_id, bitcode);
+        return;
+      }
+      if (!(block_id == kIdentificationBlockId ? ParseBlock(block_id, bitcode) : SkipBlock())) {
+        return;
+      }
+    }
+  }
+
+ private:
+  bool SkipBlock() {
+    std::uint64_t width, words;
+    return reader_.Vbr(4, width) && reader_.Align32() && reader_.Fixed(32, words) && reader_.SkipWords(words);
+  }
+
+  bool ParseBlock(std::uint64_t block_id, scnr::BitcodeFile& bitcode) {
+    std::uint64_t width, words;
+    if (!reader_.Vbr(4, width) || width < 2 || width > 32 || !reader_.Align32() || !reader_.Fixed(32, words)) {
+      return false;
+    }
+    std::vector<Abbrev> abbrevs;
+    while (entries_++ < kMaxBitcodeEntries) {
+      std::uint64_t abbrev_id;
+      if (!reader_.Fixed(static_cast<int>(width), abbrev_id)) {
+        return false;
+      }
+      if (abbrev_id == kEndBlock) {
+        return reader_.Align32();
+      }
+      if (abbrev_id == kEnterSubblock) {
+        std::uint64_t nested;
+        if (!reader_.Vbr(8, nested) || !SkipBlock()) {
+          return false;
+        }
+        continue;
+      }
+      if (abbrev_id == kDefineAbbrev) {
+        if (!DefineAbbrev(abbrevs)) {
+          return false;
+        }
+        continue;
+      }
+      Record record;
+      if (abbrev_id == kUnabbrevRecord) {
+        if (!ReadUnabbrevRecord(record)) {
+          return false;
+        }
+      } else if (abbrev_id - kFirstApplicationAbbrev >= abbrevs.size() ||
+                 !ReadRecord(abbrevs[abbrev_id - kFirstApplicationAbbrev], record)) {
+        return false;
+      }
+      if (block_id == kIdentificationBlockId && record.code == kIdentificationCodeString) {
+        bitcode.details.producer = record.AsString();
+      } else if (block_id == kModuleBlockId && record.code == kModuleCodeTriple) {
+        bitcode.triple = record.AsString();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool DefineAbbrev(std::vector<Abbrev>& abbrevs) {
+    std::uint64_t nops;
+    if (!reader_.Vbr(5, nops)) {
+      return false;
+    }
+    Abbrev abbrev;
+    for (std::uint64_t i = 0; i < nops; ++i) {
+      std::uint64_t literal, encoding;
+      AbbrevOp op;
+      if (!reader_.Fixed(1, literal)) {
+        return false;
+      }
+      if (literal) {
+        if (!reader_.Vbr(8, op.value)) {
+          return false;
+        }
+        abbrev.push_back(op);
+        continue;
+      }
+      if (!reader_.Fixed(3, encoding) || encoding < 1 || encoding > 5) {
+        return false;
+      }
+      op.encoding = static_cast<AbbrevOp::Encoding>(encoding);
+      if (op.encoding == AbbrevOp::Encoding::kFixed || op.encoding == AbbrevOp::Encoding::kVbr) {
+        if (!reader_.Vbr(5, op.value) || op.value > 32) {
+          return false;
+        }
+        // a zero width operand is always zero
+        if (op.value == 0) {
+          op.encoding = AbbrevOp::Encoding::kLiteral;
+        }
+      }
+      abbrev.push_back(op);
+    }
+    abbrevs.push_back(std::move(abbrev));
+    return true;
+  }
+
+  bool ReadUnabbrevRecord(Record& record) {
+    std::uint64_t nops;
+    if (!reader_.Vbr(6, record.code) || !reader_.Vbr(6, nops)) {
+      return false;
+    }
+    for (std::uint64_t i = 0; i < nops; ++i) {
+      std::uint64_t op;
+      if (!reader_.Vbr(6, op)) {
+        return false;
+      }
+      record.Add(op);
+    }
+    return true;
+  }
+
+  bool ReadScalar(const AbbrevOp& op, std::uint64_t& value) {
+    switch (op.encoding) {
+      case AbbrevOp::Encoding::kLiteral:
+        value = op.value;
+        return true;
+      case AbbrevOp::Encoding::kFixed:
+        return reader_.Fixed(static_cast<int>(op.value), value);
+      case AbbrevOp::Encoding::kVbr:
+        return reader_.Vbr(static_cast<int>(op.value), value);
+      case AbbrevOp::Encoding::kChar6:
+        if (!reader_.Fixed(6, value)) {
+          return false;
+        }
+        value = static_cast<unsigned char>(decode_char6(value));
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  // The first operand of an abbreviation is the record code
+  bool ReadRecord(const Abbrev& abbrev, Record& record) {
+    bool has_code = false;
+    for (size_t i = 0; i < abbrev.size(); ++i) {
+      const AbbrevOp& op = abbrev[i];
+      std::uint64_t value = 0;
+      if (op.encoding == AbbrevOp::Encoding::kArray) {
+        // the element type is the next and last operand
+        std::uint64_t count;
+        if (i + 2 != abbrev.size() || !reader_.Vbr(6, count)) {
+          return false;
+        }
+        for (std::uint64_t j = 0; j < count; ++j) {
+          if (!ReadScalar(abbrev[i + 1], value)) {
+            return false;
+          }
+          record.Add(value);
+        }
+        return has_code;
+      }
+      if (op.encoding == AbbrevOp::Encoding::kBlob) {
+        std::uint64_t size;
+        if (!reader_.Vbr(6, size) || !reader_.Align32() || !reader_.SkipWords((size + 3) / 4)) {
+          return false;
+        }
+        continue;
+      }
+      if (!ReadScalar(op, value)) {
+        return false;
+      }
+      if (has_code) {
+        record.Add(value);
+      } else {
+        record.code = value;
+        has_code = true;
+      }
+    }
+    return has_code;
+  }
+
+  BitReader reader_;
+  size_t entries_ = 0;
+};
+
+}  // namespace
+
+namespace scnr {
+
+std::optional<WasmFile> try_wasm(scnr::StreamData stream) {
+  Byte header[kWasmHeaderSize + 1];
+  const size_t nbytes = stream.readsome(header, 0, sizeof(header));
+  if (nbytes < kWasmHeaderSize || std::memcmp(header, kWasmMagic.data(), kWasmMagic.size()) != 0) {
+    return {};
+  }
+  // the version field of components is split into a version and a layer
+  WasmFile retval{.version = get_le<std::uint16_t>(header + 4)};
+  const auto layer = get_le<std::uint16_t>(header + 6);
+  if (layer > 1 || retval.version == 0) {
+    return {};
+  }
+  retval.component = layer == 1;
+  if (!retval.component && nbytes > kWasmHeaderSize && header[kWasmHeaderSize] > kWasmMaxSectionId) {
+    return {};
+  }
+  return retval;
+}
+
+std::optional<JavaClassFile> try_java_class(scnr::StreamData stream) {
+  Byte header[kJavaHeaderSize];
+  if (!stream.read(header, 0, sizeof(header)) || get_be<std::uint32_t>(header) != kJavaMagic) {
+    return {};
+  }
+  JavaClassFile retval{.major = get_be<std::uint16_t>(header + 6), .minor = get_be<std::uint16_t>(header + 4)};
+  // the constant pool count is one more than the number of entries
+  if (retval.major < kJavaMinMajor || retval.major > kJavaMaxMajor || get_be<std::uint16_t>(header + 8) == 0) {
+    return {};
+  }
+  return retval;
+}
+
+std::optional<DexFile> try_dex(scnr::StreamData stream) {
+  Byte header[kDexEndianTagOffset + sizeof(std::uint32_t)];
+  if (!stream.read(header, 0, sizeof(header))) {
+    return {};
+  }
+  const std::string_view magic(reinterpret_cast<const char*>(header), kDexMagic.size());
+  if (magic != kDexMagic && magic != kCompactDexMagic) {
+    return {};
+  }
+  // the magic goes on with a three digit version and a NUL, e.g. dex\n035\0
+  DexFile retval{.compact = magic == kCompactDexMagic};
+  for (size_t i = 4; i < 7; ++i) {
+    if (header[i] < '0' || header[i] > '9') {
+      return {};
+    }
+    retval.version = retval.version * 10 + (header[i] - '0');
+  }
+  if (header[7] != '\0' || get_le<std::uint32_t>(header + kDexEndianTagOffset) != kDexEndianConstant) {
+    return {};
+  }
+  return retval;
+}
+
+std::optional<BitcodeFile> try_bitcode(scnr::StreamData unbounded) {
+  ReadBudget budget(kMaxBitcodeReads, kMaxBitcodeBytes);
+  auto stream = unbounded.budgeted(&budget);
+
+  Byte header[kBitcodeWrapperSize];
+  const size_t nbytes = stream.readsome(header, 0, sizeof(header));
+  if (nbytes < kBitcodeMagic.size()) {
+    return {};
+  }
+  // the wrapper tells where the bitcode is, the rest of it is a Mach-O cputype the triple says more precisely
+  size_t offset = 0;
+  size_t size = std::numeric_limits<size_t>::max();
+  if (nbytes == sizeof(header) && get_le<std::uint32_t>(header) == kBitcodeWrapperMagic) {
+    offset = get_le<std::uint32_t>(header + 8);
+    size = get_le<std::uint32_t>(header + 12);
+    if (stream.readsome(header, offset, kBitcodeMagic.size()) != kBitcodeMagic.size()) {
+      return {};
+    }
+  }
+  if (std::memcmp(header, kBitcodeMagic.data(), kBitcodeMagic.size()) != 0) {
+    return {};
+  }
+
+  BitcodeFile retval;
+  BitcodeParser parser(stream.sliced(offset, size).advanced(kBitcodeMagic.size()));
+  parser.Parse(retval);
+  return retval;
+}
+
+}  // namespace scnr
@@ -0,0 +1,88 @@
+#include <scnr/inflate.hpp>
+#include <scnr/parse_compressed.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string_view>
+
+namespace {
+
+constexpr std::string_view kGzipMagic = "\x1f\x8b";
+constexpr std::string_view kXzMagic{"\xfd" "7zXZ\0", 6};
+constexpr std::string_view kZstdMagic = "\x28\xb5\x2f\xfd";
+
+constexpr std::uint8_t kGzipDeflate = 8;
+constexpr size_t kGzipHeaderSize = 10;
+constexpr std::uint8_t kGzipHeaderCrc = 0x02;
+constexpr std::uint8_t kGzipExtra = 0x04;
+constexpr std::uint8_t kGzipName = 0x08;
+constexpr std::uint8_t kGzipComment = 0x10;
+// Optional header fields are read at once, the content of files with longer ones is not looked at
+constexpr size_t kMaxGzipHeader = 4096;
+
+bool starts_with(const scnr::Byte* buf, size_t size, std::string_view magic) {
+  return size >= magic.size() && std::memcmp(buf, magic.data(), magic.size()) == 0;
+}
+
+// Offset of the deflate stream behind the member header
+std::optional<size_t> gzip_data_offset(scnr::StreamData stream) {
+  scnr::Byte header[kMaxGzipHeader];
+  const size_t nbytes = stream.readsome(header, 0, sizeof(header));
+  if (nbytes < kGzipHeaderSize || header[2] != kGzipDeflate) {
+    return {};
+  }
+  const std::uint8_t flags = header[3];
+  size_t pos = kGzipHeaderSize;
+  if (flags & kGzipExtra) {
+    if (pos + 2 > nbytes) {
+      return {};
+    }
+    pos += 2 + (header[pos] | (header[pos + 1] << 8));
+  }
+  for (std::uint8_t field : {kGzipName, kGzipComment}) {
+    if (!(flags & field)) {
+      continue;
+    }
+    const void* end = pos < nbytes ? std::memchr(header + pos, '\0', nbytes - pos) : nullptr;
+    if (!end) {
+      return {};
+    }
+    pos = static_cast<const scnr::Byte*>(end) - header + 1;
+  }
+  if (flags & kGzipHeaderCrc) {
+    pos += 2;
+  }
+  if (pos > nbytes) {
+    return {};
+  }
+  return pos;
+}
+
+}  // namespace
+
+namespace scnr {
+
+std::optional<std::string_view> try_compressed(scnr::StreamData stream, size_t max_content,
+                                               const ContentVisitor& visit) {
+  Byte magic[kXzMagic.size()];
+  const size_t nbytes = stream.readsome(magic, 0, sizeof(magic));
+  if (starts_with(magic, nbytes, kXzMagic)) {
+    return "xz";
+  }
+  if (starts_with(magic, nbytes, kZstdMagic)) {
+    return "zstd";
+  }
+  if (!starts_with(magic, nbytes, kGzipMagic) || nbytes < 3 || magic[2] != kGzipDeflate) {
+    return {};
+  }
+  if (visit) {
+    if (auto offset = gzip_data_offset(stream)) {
+      InflatingStream content(stream.advanced(offset.value()), max_content);
+      visit(stream.redirected(&content));
+    }
+  }
+  return "gzip";
+}
+
+}  // namespace scnr
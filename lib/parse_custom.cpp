@@ -0,0 +1,233 @@
+#include <scnr/parse_custom.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Rules look no further into a file
+constexpr size_t kMaxHead = 64 * 1024;
+// Bytes of a rule that make up the key of its group
+constexpr size_t kKeySize = 4;
+
+[[noreturn]] void throw_rule_error(size_t lineno, std::string_view message) {
+  std::stringstream ss;
+  ss << "line " << lineno << ": " << message;
+  throw std::runtime_error(ss.str());
+}
+
+std::string_view trim(std::string_view str) {
+  const auto first = str.find_first_not_of(" \t\r");
+  if (first == std::string_view::npos) {
+    return {};
+  }
+  return str.substr(first, str.find_last_not_of(" \t\r") - first + 1);
+}
+
+int hex_digit(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+std::optional<std::vector<scnr::Byte>> parse_hex(std::string_view hex) {
+  if (hex.empty() || hex.size() % 2 != 0) {
+    return {};
+  }
+  std::vector<scnr::Byte> retval;
+  for (size_t i = 0; i < hex.size(); i += 2) {
+    const int high = hex_digit(hex[i]);
+    const int low = hex_digit(hex[i + 1]);
+    if (high < 0 || low < 0) {
+      return {};
+    }
+    retval.push_back(high << 4 | low);
+  }
+  return retval;
+}
+
+std::optional<size_t> parse_offset(std::string_view str) {
+  unsigned base = 10;
+  if (str.size() > 2 && str[0] == '0' && (str[1] == 'x' || str[1] == 'X')) {
+    base = 16;
+    str.remove_prefix(2);
+  }
+  if (str.empty()) {
+    return {};
+  }
+  size_t retval = 0;
+  for (char c : str) {
+    const int digit = hex_digit(c);
+    if (digit < 0 || static_cast<unsigned>(digit) >= base || retval > kMaxHead) {
+      return {};
+    }
+    retval = retval * base + digit;
+  }
+  return retval;
+}
+
+// Bytes as words in host order, the head is loaded the same way
+std::vector<std::uint64_t> to_words(const std::vector<scnr::Byte>& bytes) {
+  std::vector<std::uint64_t> retval((bytes.size() + 7) / 8);
+  std::memcpy(retval.data(), bytes.data(), bytes.size());
+  return retval;
+}
+
+// Key of the first bytes, byte by byte so it does not depend on the host byte order
+std::uint32_t key_of(const scnr::Byte* bytes, size_t size) {
+  std::uint32_t retval = 0;
+  for (size_t i = 0; i < std::min(size, kKeySize); ++i) {
+    retval |= std::uint32_t{bytes[i]} << (8 * i);
+  }
+  return retval;
+}
+
+}  // namespace
+
+namespace scnr {
+
+MagicRules MagicRules::Parse(std::istream& in) {
+  MagicRules retval;
+  std::string line;
+  for (size_t lineno = 1; std::getline(in, line); ++lineno) {
+    const std::string_view text = trim(line);
+    if (text.empty() || text[0] == '#') {
+      continue;
+    }
+    std::istringstream fields{std::string(text)};
+    std::string offset_field, magic_field, name;
+    fields >> offset_field >> magic_field;
+    std::getline(fields, name);
+
+    Rule rule{.name = std::string(trim(name))};
+    if (rule.name.empty()) {
+      throw_rule_error(lineno, "expected offset, magic and name");
+    }
+    const auto offset = parse_offset(offset_field);
+    if (!offset) {
+      throw_rule_error(lineno, "bad offset '" + offset_field + "'");
+    }
+    const std::string_view magic_text = magic_field;
+    const auto slash = magic_text.find('/');
+    auto magic = parse_hex(magic_text.substr(0, slash));
+    auto mask = slash == std::string_view::npos ? magic : parse_hex(magic_text.substr(slash + 1));
+    if (!magic || !mask) {
+      throw_rule_error(lineno, "bad hex bytes '" + magic_field + "'");
+    }
+    if (slash == std::string_view::npos) {
+      std::fill(mask->begin(), mask->end(), 0xff);
+    } else if (mask->size() != magic->size()) {
+      throw_rule_error(lineno, "mask and magic differ in length");
+    }
+    if (offset.value() + magic->size() > kMaxHead) {
+      throw_rule_error(lineno, "magic ends past the first 64 KiB");
+    }
+    for (size_t i = 0; i < magic->size(); ++i) {
+      (*magic)[i] &= (*mask)[i];
+    }
+    rule.offset = offset.value();
+    rule.length = magic->size();
+    rule.magic = to_words(magic.value());
+    rule.mask = to_words(mask.value());
+
+    // rules with the same offset and key mask share a group
+    const std::uint32_t group_mask = key_of(mask->data(), mask->size());
+    auto group = std::find_if(retval.groups_.begin(), retval.groups_.end(), [&](const Group& other) {
+      return other.offset == rule.offset && other.mask == group_mask;
+    });
+    if (group == retval.groups_.end()) {
+      group = retval.groups_.insert(retval.groups_.end(), Group{.offset = rule.offset, .mask = group_mask});
+    }
+    group->keys.emplace_back(key_of(magic->data(), magic->size()), static_cast<std::uint32_t>(retval.rules_.size()));
+    retval.head_size_ = std::max(retval.head_size_, rule.offset + rule.length);
+    retval.rules_.push_back(std::move(rule));
+  }
+  for (auto& group : retval.groups_) {
+    std::sort(group.keys.begin(), group.keys.end());
+  }
+  return retval;
+}
+
+MagicRules MagicRules::Load(const std::filesystem::path& path) {
+  std::ifstream in(path);
+  if (!in.is_open()) {
+    std::stringstream ss;
+    // u8
+    ss << "Failed to open magic rules '" << path.string() << "'";
+    throw std::runtime_error(ss.str());
+  }
+  try {
+    return Parse(in);
+  } catch (const std::runtime_error& ex) {
+    std::stringstream ss;
+    // u8
+    ss << "Bad magic rule in '" << path.string() << "', " << ex.what();
+    throw std::runtime_error(ss.str());
+  }
+}
+
+bool MagicRules::Verify(const Rule& rule, const Byte* head, size_t size) const {
+  if (rule.offset + rule.length > size) {
+    return false;
+  }
+  for (size_t w = 0; w < rule.magic.size(); ++w) {
+    std::uint64_t word = 0;
+    std::memcpy(&word, head + rule.offset + 8 * w, std::min<size_t>(8, rule.length - 8 * w));
+    if ((word & rule.mask[w]) != rule.magic[w]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::optional<std::string_view> MagicRules::Match(const Byte* head, size_t size) const {
+  std::optional<std::uint32_t> best;
+  for (const auto& group : groups_) {
+    if (group.offset >= size) {
+      continue;
+    }
+    const std::uint32_t key = key_of(head + group.offset, size - group.offset) & group.mask;
+    // the rules of a key are sorted by index, the first one that verifies is the group's best
+    for (auto it = std::lower_bound(group.keys.begin(), group.keys.end(), std::make_pair(key, std::uint32_t{0}));
+         it != group.keys.end() && it->first == key && (!best || it->second < best.value()); ++it) {
+      if (Verify(rules_[it->second], head, size)) {
+        best = it->second;
+        break;
+      }
+    }
+  }
+  if (!best) {
+    return {};
+  }
+  return rules_[best.value()].name;
+}
+
+std::optional<CustomFile> try_custom(scnr::StreamData stream, const MagicRules& rules) {
+  if (rules.size() == 0) {
+    return {};
+  }
+  std::vector<Byte> head(rules.HeadSize());
+  const size_t nbytes = stream.readsome(head.data(), 0, head.size());
+  if (auto name = rules.Match(head.data(), nbytes)) {
+    return CustomFile{.name = std::string(name.value())};
+  }
+  return {};
+}
+
+}  // namespace scnr
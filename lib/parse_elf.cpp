@@ -1,241 +1,482 @@
 #include <scnr/file.hpp>
+#include <scnr/name_table.hpp>
 #include <scnr/parse_elf.hpp>
 #include <scnr/types.hpp>
 #include <scnr/util.hpp>
 
+#include <algorithm>
+#include <cstring>
 #include <optional>
 #include <type_traits>
+#include <utility>
+#include <vector>
 
 #include <scnr/elf/elf.h>
 
 namespace {
-std::string_view CpuTypeAsSV(Elf64_Half cputype) {
-  std::string_view retval;
-
-#define SCNR_CASE_MACRO(code)                                                                                          \
-  case code:                                                                                                           \
-    retval = #code;                                                                                                    \
-    break
-  switch (cputype) {
-    SCNR_CASE_MACRO(EM_NONE);
-    SCNR_CASE_MACRO(EM_M32);
-    SCNR_CASE_MACRO(EM_SPARC);
-    SCNR_CASE_MACRO(EM_386);
-    SCNR_CASE_MACRO(EM_68K);
-    SCNR_CASE_MACRO(EM_88K);
-    SCNR_CASE_MACRO(EM_IAMCU);
-    SCNR_CASE_MACRO(EM_860);
-    SCNR_CASE_MACRO(EM_MIPS);
-    SCNR_CASE_MACRO(EM_S370);
-    SCNR_CASE_MACRO(EM_MIPS_RS3_LE);
-    SCNR_CASE_MACRO(EM_PARISC);
-    SCNR_CASE_MACRO(EM_VPP500);
-    SCNR_CASE_MACRO(EM_SPARC32PLUS);
-    SCNR_CASE_MACRO(EM_960);
-    SCNR_CASE_MACRO(EM_PPC);
-    SCNR_CASE_MACRO(EM_PPC64);
-    SCNR_CASE_MACRO(EM_S390);
-    SCNR_CASE_MACRO(EM_SPU);
-    SCNR_CASE_MACRO(EM_V800);
-    SCNR_CASE_MACRO(EM_FR20);
-    SCNR_CASE_MACRO(EM_RH32);
-    SCNR_CASE_MACRO(EM_RCE);
-    SCNR_CASE_MACRO(EM_ARM);
-    SCNR_CASE_MACRO(EM_FAKE_ALPHA);
-    SCNR_CASE_MACRO(EM_SH);
-    SCNR_CASE_MACRO(EM_SPARCV9);
-    SCNR_CASE_MACRO(EM_TRICORE);
-    SCNR_CASE_MACRO(EM_ARC);
-    SCNR_CASE_MACRO(EM_H8_300);
-    SCNR_CASE_MACRO(EM_H8_300H);
-    SCNR_CASE_MACRO(EM_H8S);
-    SCNR_CASE_MACRO(EM_H8_500);
-    SCNR_CASE_MACRO(EM_IA_64);
-    SCNR_CASE_MACRO(EM_MIPS_X);
-    SCNR_CASE_MACRO(EM_COLDFIRE);
-    SCNR_CASE_MACRO(EM_68HC12);
-    SCNR_CASE_MACRO(EM_MMA);
-    SCNR_CASE_MACRO(EM_PCP);
-    SCNR_CASE_MACRO(EM_NCPU);
-    SCNR_CASE_MACRO(EM_NDR1);
-    SCNR_CASE_MACRO(EM_STARCORE);
-    SCNR_CASE_MACRO(EM_ME16);
-    SCNR_CASE_MACRO(EM_ST100);
-    SCNR_CASE_MACRO(EM_TINYJ);
-    SCNR_CASE_MACRO(EM_X86_64);
-    SCNR_CASE_MACRO(EM_PDSP);
-    SCNR_CASE_MACRO(EM_PDP10);
-    SCNR_CASE_MACRO(EM_PDP11);
-    SCNR_CASE_MACRO(EM_FX66);
-    SCNR_CASE_MACRO(EM_ST9PLUS);
-    SCNR_CASE_MACRO(EM_ST7);
-    SCNR_CASE_MACRO(EM_68HC16);
-    SCNR_CASE_MACRO(EM_68HC11);
-    SCNR_CASE_MACRO(EM_68HC08);
-    SCNR_CASE_MACRO(EM_68HC05);
-    SCNR_CASE_MACRO(EM_SVX);
-    SCNR_CASE_MACRO(EM_ST19);
-    SCNR_CASE_MACRO(EM_VAX);
-    SCNR_CASE_MACRO(EM_CRIS);
-    SCNR_CASE_MACRO(EM_JAVELIN);
-    SCNR_CASE_MACRO(EM_FIREPATH);
-    SCNR_CASE_MACRO(EM_ZSP);
-    SCNR_CASE_MACRO(EM_MMIX);
-    SCNR_CASE_MACRO(EM_HUANY);
-    SCNR_CASE_MACRO(EM_PRISM);
-    SCNR_CASE_MACRO(EM_AVR);
-    SCNR_CASE_MACRO(EM_FR30);
-    SCNR_CASE_MACRO(EM_D10V);
-    SCNR_CASE_MACRO(EM_D30V);
-    SCNR_CASE_MACRO(EM_V850);
-    SCNR_CASE_MACRO(EM_M32R);
-    SCNR_CASE_MACRO(EM_MN10300);
-    SCNR_CASE_MACRO(EM_MN10200);
-    SCNR_CASE_MACRO(EM_PJ);
-    SCNR_CASE_MACRO(EM_OPENRISC);
-    SCNR_CASE_MACRO(EM_ARC_COMPACT);
-    SCNR_CASE_MACRO(EM_XTENSA);
-    SCNR_CASE_MACRO(EM_VIDEOCORE);
-    SCNR_CASE_MACRO(EM_TMM_GPP);
-    SCNR_CASE_MACRO(EM_NS32K);
-    SCNR_CASE_MACRO(EM_TPC);
-    SCNR_CASE_MACRO(EM_SNP1K);
-    SCNR_CASE_MACRO(EM_ST200);
-    SCNR_CASE_MACRO(EM_IP2K);
-    SCNR_CASE_MACRO(EM_MAX);
-    SCNR_CASE_MACRO(EM_CR);
-    SCNR_CASE_MACRO(EM_F2MC16);
-    SCNR_CASE_MACRO(EM_MSP430);
-    SCNR_CASE_MACRO(EM_BLACKFIN);
-    SCNR_CASE_MACRO(EM_SE_C33);
-    SCNR_CASE_MACRO(EM_SEP);
-    SCNR_CASE_MACRO(EM_ARCA);
-    SCNR_CASE_MACRO(EM_UNICORE);
-    SCNR_CASE_MACRO(EM_EXCESS);
-    SCNR_CASE_MACRO(EM_DXP);
-    SCNR_CASE_MACRO(EM_ALTERA_NIOS2);
-    SCNR_CASE_MACRO(EM_CRX);
-    SCNR_CASE_MACRO(EM_XGATE);
-    SCNR_CASE_MACRO(EM_C166);
-    SCNR_CASE_MACRO(EM_M16C);
-    SCNR_CASE_MACRO(EM_DSPIC30F);
-    SCNR_CASE_MACRO(EM_CE);
-    SCNR_CASE_MACRO(EM_M32C);
-    SCNR_CASE_MACRO(EM_TSK3000);
-    SCNR_CASE_MACRO(EM_RS08);
-    SCNR_CASE_MACRO(EM_SHARC);
-    SCNR_CASE_MACRO(EM_ECOG2);
-    SCNR_CASE_MACRO(EM_SCORE7);
-    SCNR_CASE_MACRO(EM_DSP24);
-    SCNR_CASE_MACRO(EM_VIDEOCORE3);
-    SCNR_CASE_MACRO(EM_LATTICEMICO32);
-    SCNR_CASE_MACRO(EM_SE_C17);
-    SCNR_CASE_MACRO(EM_TI_C6000);
-    SCNR_CASE_MACRO(EM_TI_C2000);
-    SCNR_CASE_MACRO(EM_TI_C5500);
-    SCNR_CASE_MACRO(EM_TI_ARP32);
-    SCNR_CASE_MACRO(EM_TI_PRU);
-    SCNR_CASE_MACRO(EM_MMDSP_PLUS);
-    SCNR_CASE_MACRO(EM_CYPRESS_M8C);
-    SCNR_CASE_MACRO(EM_R32C);
-    SCNR_CASE_MACRO(EM_TRIMEDIA);
-    SCNR_CASE_MACRO(EM_QDSP6);
-    SCNR_CASE_MACRO(EM_8051);
-    SCNR_CASE_MACRO(EM_STXP7X);
-    SCNR_CASE_MACRO(EM_NDS32);
-    SCNR_CASE_MACRO(EM_ECOG1X);
-    SCNR_CASE_MACRO(EM_MAXQ30);
-    SCNR_CASE_MACRO(EM_XIMO16);
-    SCNR_CASE_MACRO(EM_MANIK);
-    SCNR_CASE_MACRO(EM_CRAYNV2);
-    SCNR_CASE_MACRO(EM_RX);
-    SCNR_CASE_MACRO(EM_METAG);
-    SCNR_CASE_MACRO(EM_MCST_ELBRUS);
-    SCNR_CASE_MACRO(EM_ECOG16);
-    SCNR_CASE_MACRO(EM_CR16);
-    SCNR_CASE_MACRO(EM_ETPU);
-    SCNR_CASE_MACRO(EM_SLE9X);
-    SCNR_CASE_MACRO(EM_L10M);
-    SCNR_CASE_MACRO(EM_K10M);
-    SCNR_CASE_MACRO(EM_AARCH64);
-    SCNR_CASE_MACRO(EM_AVR32);
-    SCNR_CASE_MACRO(EM_STM8);
-    SCNR_CASE_MACRO(EM_TILE64);
-    SCNR_CASE_MACRO(EM_TILEPRO);
-    SCNR_CASE_MACRO(EM_MICROBLAZE);
-    SCNR_CASE_MACRO(EM_CUDA);
-    SCNR_CASE_MACRO(EM_TILEGX);
-    SCNR_CASE_MACRO(EM_CLOUDSHIELD);
-    SCNR_CASE_MACRO(EM_COREA_1ST);
-    SCNR_CASE_MACRO(EM_COREA_2ND);
-    SCNR_CASE_MACRO(EM_ARCV2);
-    SCNR_CASE_MACRO(EM_OPEN8);
-    SCNR_CASE_MACRO(EM_RL78);
-    SCNR_CASE_MACRO(EM_VIDEOCORE5);
-    SCNR_CASE_MACRO(EM_78KOR);
-    SCNR_CASE_MACRO(EM_56800EX);
-    SCNR_CASE_MACRO(EM_BA1);
-    SCNR_CASE_MACRO(EM_BA2);
-    SCNR_CASE_MACRO(EM_XCORE);
-    SCNR_CASE_MACRO(EM_MCHP_PIC);
-    SCNR_CASE_MACRO(EM_INTELGT);
-    SCNR_CASE_MACRO(EM_KM32);
-    SCNR_CASE_MACRO(EM_KMX32);
-    SCNR_CASE_MACRO(EM_EMX16);
-    SCNR_CASE_MACRO(EM_EMX8);
-    SCNR_CASE_MACRO(EM_KVARC);
-    SCNR_CASE_MACRO(EM_CDP);
-    SCNR_CASE_MACRO(EM_COGE);
-    SCNR_CASE_MACRO(EM_COOL);
-    SCNR_CASE_MACRO(EM_NORC);
-    SCNR_CASE_MACRO(EM_CSR_KALIMBA);
-    SCNR_CASE_MACRO(EM_Z80);
-    SCNR_CASE_MACRO(EM_VISIUM);
-    SCNR_CASE_MACRO(EM_FT32);
-    SCNR_CASE_MACRO(EM_MOXIE);
-    SCNR_CASE_MACRO(EM_AMDGPU);
-    SCNR_CASE_MACRO(EM_RISCV);
-    SCNR_CASE_MACRO(EM_BPF);
-    SCNR_CASE_MACRO(EM_CSKY);
-    SCNR_CASE_MACRO(EM_LOONGARCH);
-    default:
-      return {};
-  }
-#undef SCNR_MACRO_CASE
-
-  retval.remove_prefix(3);  // EM_
-  return retval;
-}
+// e_machine values
+constexpr scnr::NamedValue<Elf64_Half> kMachines[] = {
+  SCNR_NAMED(EM_NONE),
+  SCNR_NAMED(EM_M32),
+  SCNR_NAMED(EM_SPARC),
+  SCNR_NAMED(EM_386),
+  SCNR_NAMED(EM_68K),
+  SCNR_NAMED(EM_88K),
+  SCNR_NAMED(EM_IAMCU),
+  SCNR_NAMED(EM_860),
+  SCNR_NAMED(EM_MIPS),
+  SCNR_NAMED(EM_S370),
+  SCNR_NAMED(EM_MIPS_RS3_LE),
+  SCNR_NAMED(EM_PARISC),
+  SCNR_NAMED(EM_VPP500),
+  SCNR_NAMED(EM_SPARC32PLUS),
+  SCNR_NAMED(EM_960),
+  SCNR_NAMED(EM_PPC),
+  SCNR_NAMED(EM_PPC64),
+  SCNR_NAMED(EM_S390),
+  SCNR_NAMED(EM_SPU),
+  SCNR_NAMED(EM_V800),
+  SCNR_NAMED(EM_FR20),
+  SCNR_NAMED(EM_RH32),
+  SCNR_NAMED(EM_RCE),
+  SCNR_NAMED(EM_ARM),
+  SCNR_NAMED(EM_FAKE_ALPHA),
+  SCNR_NAMED(EM_SH),
+  SCNR_NAMED(EM_SPARCV9),
+  SCNR_NAMED(EM_TRICORE),
+  SCNR_NAMED(EM_ARC),
+  SCNR_NAMED(EM_H8_300),
+  SCNR_NAMED(EM_H8_300H),
+  SCNR_NAMED(EM_H8S),
+  SCNR_NAMED(EM_H8_500),
+  SCNR_NAMED(EM_IA_64),
+  SCNR_NAMED(EM_MIPS_X),
+  SCNR_NAMED(EM_COLDFIRE),
+  SCNR_NAMED(EM_68HC12),
+  SCNR_NAMED(EM_MMA),
+  SCNR_NAMED(EM_PCP),
+  SCNR_NAMED(EM_NCPU),
+  SCNR_NAMED(EM_NDR1),
+  SCNR_NAMED(EM_STARCORE),
+  SCNR_NAMED(EM_ME16),
+  SCNR_NAMED(EM_ST100),
+  SCNR_NAMED(EM_TINYJ),
+  SCNR_NAMED(EM_X86_64),
+  SCNR_NAMED(EM_PDSP),
+  SCNR_NAMED(EM_PDP10),
+  SCNR_NAMED(EM_PDP11),
+  SCNR_NAMED(EM_FX66),
+  SCNR_NAMED(EM_ST9PLUS),
+  SCNR_NAMED(EM_ST7),
+  SCNR_NAMED(EM_68HC16),
+  SCNR_NAMED(EM_68HC11),
+  SCNR_NAMED(EM_68HC08),
+  SCNR_NAMED(EM_68HC05),
+  SCNR_NAMED(EM_SVX),
+  SCNR_NAMED(EM_ST19),
+  SCNR_NAMED(EM_VAX),
+  SCNR_NAMED(EM_CRIS),
+  SCNR_NAMED(EM_JAVELIN),
+  SCNR_NAMED(EM_FIREPATH),
+  SCNR_NAMED(EM_ZSP),
+  SCNR_NAMED(EM_MMIX),
+  SCNR_NAMED(EM_HUANY),
+  SCNR_NAMED(EM_PRISM),
+  SCNR_NAMED(EM_AVR),
+  SCNR_NAMED(EM_FR30),
+  SCNR_NAMED(EM_D10V),
+  SCNR_NAMED(EM_D30V),
+  SCNR_NAMED(EM_V850),
+  SCNR_NAMED(EM_M32R),
+  SCNR_NAMED(EM_MN10300),
+  SCNR_NAMED(EM_MN10200),
+  SCNR_NAMED(EM_PJ),
+  SCNR_NAMED(EM_OPENRISC),
+  SCNR_NAMED(EM_ARC_COMPACT),
+  SCNR_NAMED(EM_XTENSA),
+  SCNR_NAMED(EM_VIDEOCORE),
+  SCNR_NAMED(EM_TMM_GPP),
+  SCNR_NAMED(EM_NS32K),
+  SCNR_NAMED(EM_TPC),
+  SCNR_NAMED(EM_SNP1K),
+  SCNR_NAMED(EM_ST200),
+  SCNR_NAMED(EM_IP2K),
+  SCNR_NAMED(EM_MAX),
+  SCNR_NAMED(EM_CR),
+  SCNR_NAMED(EM_F2MC16),
+  SCNR_NAMED(EM_MSP430),
+  SCNR_NAMED(EM_BLACKFIN),
+  SCNR_NAMED(EM_SE_C33),
+  SCNR_NAMED(EM_SEP),
+  SCNR_NAMED(EM_ARCA),
+  SCNR_NAMED(EM_UNICORE),
+  SCNR_NAMED(EM_EXCESS),
+  SCNR_NAMED(EM_DXP),
+  SCNR_NAMED(EM_ALTERA_NIOS2),
+  SCNR_NAMED(EM_CRX),
+  SCNR_NAMED(EM_XGATE),
+  SCNR_NAMED(EM_C166),
+  SCNR_NAMED(EM_M16C),
+  SCNR_NAMED(EM_DSPIC30F),
+  SCNR_NAMED(EM_CE),
+  SCNR_NAMED(EM_M32C),
+  SCNR_NAMED(EM_TSK3000),
+  SCNR_NAMED(EM_RS08),
+  SCNR_NAMED(EM_SHARC),
+  SCNR_NAMED(EM_ECOG2),
+  SCNR_NAMED(EM_SCORE7),
+  SCNR_NAMED(EM_DSP24),
+  SCNR_NAMED(EM_VIDEOCORE3),
+  SCNR_NAMED(EM_LATTICEMICO32),
+  SCNR_NAMED(EM_SE_C17),
+  SCNR_NAMED(EM_TI_C6000),
+  SCNR_NAMED(EM_TI_C2000),
+  SCNR_NAMED(EM_TI_C5500),
+  SCNR_NAMED(EM_TI_ARP32),
+  SCNR_NAMED(EM_TI_PRU),
+  SCNR_NAMED(EM_MMDSP_PLUS),
+  SCNR_NAMED(EM_CYPRESS_M8C),
+  SCNR_NAMED(EM_R32C),
+  SCNR_NAMED(EM_TRIMEDIA),
+  SCNR_NAMED(EM_QDSP6),
+  SCNR_NAMED(EM_8051),
+  SCNR_NAMED(EM_STXP7X),
+  SCNR_NAMED(EM_NDS32),
+  SCNR_NAMED(EM_ECOG1X),
+  SCNR_NAMED(EM_MAXQ30),
+  SCNR_NAMED(EM_XIMO16),
+  SCNR_NAMED(EM_MANIK),
+  SCNR_NAMED(EM_CRAYNV2),
+  SCNR_NAMED(EM_RX),
+  SCNR_NAMED(EM_METAG),
+  SCNR_NAMED(EM_MCST_ELBRUS),
+  SCNR_NAMED(EM_ECOG16),
+  SCNR_NAMED(EM_CR16),
+  SCNR_NAMED(EM_ETPU),
+  SCNR_NAMED(EM_SLE9X),
+  SCNR_NAMED(EM_L10M),
+  SCNR_NAMED(EM_K10M),
+  SCNR_NAMED(EM_AARCH64),
+  SCNR_NAMED(EM_AVR32),
+  SCNR_NAMED(EM_STM8),
+  SCNR_NAMED(EM_TILE64),
+  SCNR_NAMED(EM_TILEPRO),
+  SCNR_NAMED(EM_MICROBLAZE),
+  SCNR_NAMED(EM_CUDA),
+  SCNR_NAMED(EM_TILEGX),
+  SCNR_NAMED(EM_CLOUDSHIELD),
+  SCNR_NAMED(EM_COREA_1ST),
+  SCNR_NAMED(EM_COREA_2ND),
+  SCNR_NAMED(EM_ARCV2),
+  SCNR_NAMED(EM_OPEN8),
+  SCNR_NAMED(EM_RL78),
+  SCNR_NAMED(EM_VIDEOCORE5),
+  SCNR_NAMED(EM_78KOR),
+  SCNR_NAMED(EM_56800EX),
+  SCNR_NAMED(EM_BA1),
+  SCNR_NAMED(EM_BA2),
+  SCNR_NAMED(EM_XCORE),
+  SCNR_NAMED(EM_MCHP_PIC),
+  SCNR_NAMED(EM_INTELGT),
+  SCNR_NAMED(EM_KM32),
+  SCNR_NAMED(EM_KMX32),
+  SCNR_NAMED(EM_EMX16),
+  SCNR_NAMED(EM_EMX8),
+  SCNR_NAMED(EM_KVARC),
+  SCNR_NAMED(EM_CDP),
+  SCNR_NAMED(EM_COGE),
+  SCNR_NAMED(EM_COOL),
+  SCNR_NAMED(EM_NORC),
+  SCNR_NAMED(EM_CSR_KALIMBA),
+  SCNR_NAMED(EM_Z80),
+  SCNR_NAMED(EM_VISIUM),
+  SCNR_NAMED(EM_FT32),
+  SCNR_NAMED(EM_MOXIE),
+  SCNR_NAMED(EM_AMDGPU),
+  SCNR_NAMED(EM_RISCV),
+  SCNR_NAMED(EM_BPF),
+  SCNR_NAMED(EM_CSKY),
+  SCNR_NAMED(EM_LOONGARCH),
+};
+constexpr scnr::NameTable kMachineNames(kMachines, "EM_");
 
 struct Elf32Traits {
   static constexpr bool w64 = false;
   using Elf_Ehdr = Elf32_Ehdr;
   using Elf_Phdr = Elf32_Phdr;
+  using Elf_Shdr = Elf32_Shdr;
+  using Elf_Dyn = Elf32_Dyn;
 };
 
 struct Elf64Traits {
   static constexpr bool w64 = true;
   using Elf_Ehdr = Elf64_Ehdr;
   using Elf_Phdr = Elf64_Phdr;
+  using Elf_Shdr = Elf64_Shdr;
+  using Elf_Dyn = Elf64_Dyn;
 };
 
+// Real binaries need a handful of reads, anything beyond that is a crafted or corrupt file
+constexpr size_t kMaxHeaderReads = 256;
+constexpr size_t kMaxHeaderBytes = 512 * 1024;
+// Program header tables are examined up to that size, section header tables are read in windows of that size
+constexpr size_t kMaxProgramHeadersSize = 64 * 1024;
+constexpr size_t kMaxSectionHeadersSize = 64 * 1024;
+// The dynamic section has a few dozen entries, notes of a binary fit in a page
+constexpr size_t kMaxDynamicSize = 64 * 1024;
+constexpr size_t kMaxNotesSize = 4 * 1024;
+constexpr size_t kMaxNoteSegments = 4;
+constexpr size_t kMaxNeeded = 256;
+constexpr size_t kMaxNameLength = 1024;
+// SHA-1 build-ids take 20 bytes, nothing in use takes more than 64
+constexpr size_t kMaxBuildIdSize = 64;
+
+// File-backed part of a PT_LOAD segment, maps virtual addresses found in the dynamic section to file offsets
+struct LoadSegment {
+  uint64_t vaddr = 0;
+  uint64_t offset = 0;
+  uint64_t filesz = 0;
+};
+
+std::optional<uint64_t> vaddr_to_offset(const std::vector<LoadSegment>& loads, uint64_t vaddr) {
+  for (const auto& load : loads) {
+    if (vaddr >= load.vaddr && vaddr - load.vaddr < load.filesz) {
+      return load.offset + (vaddr - load.vaddr);
+    }
+  }
+  return {};
+}
+
+// Collects DT_NEEDED and DT_SONAME. Missing or broken dynamic information leaves the details empty,
+// the file is still an ELF
 template <typename ElfTraits>
-std::optional<scnr::ElfFile> try_elf_impl(scnr::StreamData stream) {
-  scnr::Byte buf[EI_NIDENT + 1];
-  if (!stream.read(buf, 0, EI_NIDENT + 1) || buf[EI_MAG0] != ELFMAG0 || buf[EI_MAG1] != ELFMAG1 ||
-      buf[EI_MAG2] != ELFMAG2 || buf[EI_MAG3] != ELFMAG3) {
-    return {};
+void read_dynamic(scnr::StreamData stream, bool diff_endian, const std::vector<LoadSegment>& loads, uint64_t offset,
+                  uint64_t size, scnr::ElfDetails& details) {
+  typename ElfTraits::Elf_Dyn dyn;
+  const size_t count = std::min<uint64_t>(size, kMaxDynamicSize) / sizeof(dyn);
+  if (count == 0) {
+    return;
+  }
+  scnr::SmallBuffer<1024> table(count * sizeof(dyn));
+  if (!stream.read(table.data(), offset, table.size())) {
+    return;
   }
-  size_t read_bytes = 0;
 
-  scnr::ElfFile elffile;
-  elffile.w64 = ElfTraits::w64;
+  std::optional<uint64_t> strtab;
+  std::optional<uint64_t> soname;
+  uint64_t strsz = 0;
+  std::vector<uint64_t> needed;
+  for (size_t i = 0; i < count; ++i) {
+    std::memcpy(&dyn, table.data() + i * sizeof(dyn), sizeof(dyn));
+    auto tag = scnr::rev_bytes(dyn.d_tag, diff_endian);
+    auto val = scnr::rev_bytes(dyn.d_un.d_val, diff_endian);
+    if (tag == DT_NULL) {
+      break;
+    }
+    switch (tag) {
+      case DT_NEEDED:
+        if (needed.size() < kMaxNeeded) {
+          needed.push_back(val);
+        }
+        break;
+      case DT_SONAME:
+        soname = val;
+        break;
+      case DT_STRTAB:
+        strtab = val;
+        break;
+      case DT_STRSZ:
+        strsz = val;
+        break;
+      default:
+        break;
+    }
+  }
+  if (!strtab || (needed.empty() && !soname)) {
+    return;
+  }
+  auto strtab_offset = vaddr_to_offset(loads, strtab.value());
+  if (!strtab_offset) {
+    return;
+  }
+
+  // names referenced beyond DT_STRSZ are dropped
+  std::vector<uint64_t> offsets;
+  for (auto name : needed) {
+    if (name < strsz) {
+      offsets.push_back(strtab_offset.value() + name);
+    }
+  }
+  if (soname && soname.value() < strsz) {
+    offsets.push_back(strtab_offset.value() + soname.value());
+  }
+  auto names = scnr::read_cstrings(stream, offsets, std::min<uint64_t>(strsz, kMaxNameLength));
+  if (soname && soname.value() < strsz) {
+    details.soname = std::move(names.back());
+    names.pop_back();
+  }
+  for (auto& name : names) {
+    if (!name.empty()) {
+      details.needed.push_back(std::move(name));
+    }
+  }
+}
+
+// Looks for NT_GNU_BUILD_ID in a PT_NOTE segment, the note layout is the same for both classes
+void read_notes(scnr::StreamData stream, bool diff_endian, uint64_t offset, uint64_t size, uint64_t align,
+                scnr::ElfDetails& details) {
+  scnr::Byte notes[kMaxNotesSize];
+  size = std::min<uint64_t>(size, sizeof(notes));
+  if (!stream.read(notes, offset, size)) {
+    return;
+  }
+  // notes are 4-byte aligned, except in segments with 8-byte alignment such as .note.gnu.property
+  const uint64_t mask = align == 8 ? 7 : 3;
+  uint64_t pos = 0;
+  Elf64_Nhdr nhdr;
+  while (pos + sizeof(nhdr) <= size) {
+    std::memcpy(&nhdr, notes + pos, sizeof(nhdr));
+    uint64_t namesz = scnr::rev_bytes(nhdr.n_namesz, diff_endian);
+    uint64_t descsz = scnr::rev_bytes(nhdr.n_descsz, diff_endian);
+    auto type = scnr::rev_bytes(nhdr.n_type, diff_endian);
+    const uint64_t name_pos = pos + sizeof(nhdr);
+    const uint64_t desc_pos = name_pos + ((namesz + mask) & ~mask);
+    if (desc_pos + descsz > size) {
+      return;
+    }
+    if (type == NT_GNU_BUILD_ID && namesz == sizeof(ELF_NOTE_GNU) &&
+        std::memcmp(notes + name_pos, ELF_NOTE_GNU, sizeof(ELF_NOTE_GNU)) == 0 && descsz <= kMaxBuildIdSize) {
+      static constexpr char kHex[] = "0123456789abcdef";
+      for (uint64_t i = 0; i < descsz; ++i) {
+        details.build_id.push_back(kHex[notes[desc_pos + i] >> 4]);
+        details.build_id.push_back(kHex[notes[desc_pos + i] & 0xf]);
+      }
+      return;
+    }
+    pos = desc_pos + ((descsz + mask) & ~mask);
+  }
+}
+
+// Returns false if the file is broken beyond being an ELF
+template <typename ElfTraits>
+bool read_program_headers(scnr::StreamData stream, const scnr::ReadBudget& budget, bool diff_endian, uint64_t phoff,
+                          size_t phnum, size_t phentsize, scnr::ElfFile& elffile) {
+  typename ElfTraits::Elf_Phdr prg_hdr;
+
+  // PN_XNUM keeps the real count in the first section header, overlapping entries are never valid
+  if (phnum == 0 || phnum == PN_XNUM || phentsize < sizeof(prg_hdr)) {
+    return true;
+  }
+
+  const size_t count = std::min<size_t>(phnum, kMaxProgramHeadersSize / phentsize);
+  scnr::SmallBuffer<4096> table(count * phentsize);
+  if (!stream.read(table.data(), phoff, table.size())) {
+    return budget.Exhausted();
+  }
+
+  std::vector<LoadSegment> loads;
+  std::optional<std::pair<uint64_t, uint64_t>> dynamic;
+  std::vector<typename ElfTraits::Elf_Phdr> notes;
+  for (size_t i = 0; i < count; ++i) {
+    std::memcpy(&prg_hdr, table.data() + i * phentsize, sizeof(prg_hdr));
+
+    auto type = scnr::rev_bytes(prg_hdr.p_type, diff_endian);
+    auto sz = scnr::rev_bytes(prg_hdr.p_filesz, diff_endian);
+    auto offset = scnr::rev_bytes(prg_hdr.p_offset, diff_endian);
+    switch (type) {
+      case PT_INTERP: {
+        if (sz > 4098) {
+          // sanity check
+          return false;
+        }
+
+        std::string interpreter(sz, '\0');
+        if (!stream.read(interpreter.data(), offset, sz)) {
+          return false;
+        }
+        elffile.interpreter = std::move(interpreter);
+        scnr::trim_right(elffile.interpreter);
+        break;
+      }
+      case PT_LOAD:
+        loads.push_back({.vaddr = scnr::rev_bytes(prg_hdr.p_vaddr, diff_endian), .offset = offset, .filesz = sz});
+        break;
+      case PT_DYNAMIC:
+        if (!dynamic) {
+          dynamic = {offset, sz};
+        }
+        break;
+      case PT_NOTE:
+        if (notes.size() < kMaxNoteSegments) {
+          notes.push_back(prg_hdr);
+        }
+        break;
+      default:
+        break;
+    }
+  }
+
+  // PT_DYNAMIC may come before the PT_LOAD segments that map its string table
+  if (dynamic) {
+    read_dynamic<ElfTraits>(stream, diff_endian, loads, dynamic->first, dynamic->second, elffile.details);
+  }
+  for (const auto& note : notes) {
+    read_notes(stream, diff_endian, scnr::rev_bytes(note.p_offset, diff_endian),
+               scnr::rev_bytes(note.p_filesz, diff_endian), scnr::rev_bytes(note.p_align, diff_endian),
+               elffile.details);
+    if (!elffile.details.build_id.empty()) {
+      break;
+    }
+  }
+  return true;
+}
+
+// A binary is stripped if it has no SHT_SYMTAB section, sstrip-ed binaries have no section headers at all.
+// .symtab comes near the end of the table, large tables are read backwards in windows until it shows up
+template <typename ElfTraits>
+bool is_stripped(scnr::StreamData stream, bool diff_endian, uint64_t shoff, size_t shnum, size_t shentsize) {
+  typename ElfTraits::Elf_Shdr sec_hdr;
+  if (shoff == 0) {
+    return true;
+  }
+  // shnum 0 with a table present keeps the real count in the first section header, only objects with more
+  // than 65279 sections do that; they are not known to be stripped
+  if (shnum == 0 || shentsize < sizeof(sec_hdr)) {
+    return false;
+  }
+
+  const size_t window = kMaxSectionHeadersSize / shentsize;
+  scnr::SmallBuffer<4096> table(std::min(shnum, window) * shentsize);
+  for (size_t end = shnum; end > 0;) {
+    const size_t count = std::min(end, window);
+    end -= count;
+    // a table that can not be read, e.g. past the read budget, tells nothing
+    if (!stream.read(table.data(), shoff + end * shentsize, count * shentsize)) {
+      return false;
+    }
+    for (size_t i = count; i-- > 0;) {
+      std::memcpy(&sec_hdr, table.data() + i * shentsize, sizeof(sec_hdr));
+      if (scnr::rev_bytes(sec_hdr.sh_type, diff_endian) == SHT_SYMTAB) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+template <typename ElfTraits>
+std::optional<scnr::ElfFile> try_elf_impl(scnr::StreamData stream, const scnr::ReadBudget& budget,
+                                          const scnr::Byte* header, size_t header_size) {
   typename ElfTraits::Elf_Ehdr elf_hdr;
-  if (!stream.readAs(read_bytes, elf_hdr)) {
+  if (header_size < sizeof(elf_hdr)) {
     return {};
   }
+  std::memcpy(&elf_hdr, header, sizeof(elf_hdr));
 
-  switch (buf[EI_DATA]) {
+  scnr::ElfFile elffile;
+  elffile.w64 = ElfTraits::w64;
+
+  switch (elf_hdr.e_ident[EI_DATA]) {
     case ELFDATA2LSB:
       elffile.endian = std::endian::little;
       break;
@@ -250,34 +491,17 @@ std::optional<scnr::ElfFile> try_elf_impl(scnr::StreamData stream) {
   auto phoff = scnr::rev_bytes(elf_hdr.e_phoff, diff_endian);
   auto phnum = scnr::rev_bytes(elf_hdr.e_phnum, diff_endian);
   auto phentsize = scnr::rev_bytes(elf_hdr.e_phentsize, diff_endian);
+  auto shoff = scnr::rev_bytes(elf_hdr.e_shoff, diff_endian);
+  auto shnum = scnr::rev_bytes(elf_hdr.e_shnum, diff_endian);
+  auto shentsize = scnr::rev_bytes(elf_hdr.e_shentsize, diff_endian);
 
-  elffile.cputype = CpuTypeAsSV(cputype);
-
-  typename ElfTraits::Elf_Phdr prg_hdr;
+  elffile.cputype = kMachineNames[cputype];
 
-  for (int i = 0; i < phnum; ++i) {
-    if (!stream.readAs(phoff + i * phentsize, prg_hdr)) {
-      return {};
-    }
-
-    auto type = scnr::rev_bytes(prg_hdr.p_type, diff_endian);
-    if (type == PT_INTERP) {
-      auto sz = scnr::rev_bytes(prg_hdr.p_filesz, diff_endian);
-      auto offset = scnr::rev_bytes(prg_hdr.p_offset, diff_endian);
-
-      if (sz > 4098) {
-        // sanity check
-        return {};
-      }
-
-      std::string interpreter(sz, '\0');
-      if (!stream.read(interpreter.data(), offset, sz)) {
-        return {};
-      }
-      elffile.interpreter = std::move(interpreter);
-      scnr::trim_right(elffile.interpreter);
-    }
+  // program headers at the start of the file, section headers at its end
+  if (!read_program_headers<ElfTraits>(stream, budget, diff_endian, phoff, phnum, phentsize, elffile)) {
+    return {};
   }
+  elffile.stripped = is_stripped<ElfTraits>(stream, diff_endian, shoff, shnum, shentsize);
   return elffile;
 }
 
@@ -285,15 +509,21 @@ std::optional<scnr::ElfFile> try_elf_impl(scnr::StreamData stream) {
 
 namespace scnr {
 std::optional<ElfFile> try_elf(scnr::StreamData stream) {
-  Byte buf[EI_CLASS + 1];
-  if (not stream.read(buf, 0, EI_CLASS + 1)) {
+  ReadBudget budget(kMaxHeaderReads, kMaxHeaderBytes);
+  auto bounded = stream.budgeted(&budget);
+
+  // large enough for either class, ident and header come in one read
+  Byte buf[sizeof(Elf64_Ehdr)];
+  auto nbytes = bounded.readsome(buf, 0, sizeof(buf));
+  if (nbytes < EI_NIDENT || buf[EI_MAG0] != ELFMAG0 || buf[EI_MAG1] != ELFMAG1 || buf[EI_MAG2] != ELFMAG2 ||
+      buf[EI_MAG3] != ELFMAG3) {
     return {};
   }
   if (buf[EI_CLASS] == ELFCLASS32) {
-    return try_elf_impl<Elf32Traits>(stream);
+    return try_elf_impl<Elf32Traits>(bounded, budget, buf, nbytes);
   }
   if (buf[EI_CLASS] == ELFCLASS64) {
-    return try_elf_impl<Elf64Traits>(stream);
+    return try_elf_impl<Elf64Traits>(bounded, budget, buf, nbytes);
   }
   return {};
 }
@@ -1,174 +1,585 @@
 #include <scnr/parse_encoding.hpp>
 #include <scnr/types.hpp>
 
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <limits>
+#include <string_view>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64)
+  #define SCNR_SIMD_SSE2
+  #include <emmintrin.h>
+#elif (defined(__aarch64__) && defined(__ARM_NEON) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || defined(_M_ARM64)
+  #define SCNR_SIMD_NEON
+  #include <arm_neon.h>
+#endif
+
 namespace {
 
-// Printable chars, Bell, Backspace, HT, LineFeed, VT, FormFeed, CR, NEL
-bool looks_ascii(scnr::Byte c) {
-  return (32 <= c && c < 127) || (7 <= c && c < 14) || c == 133;
-}
+enum Candidate : unsigned {
+  kAscii = 1 << 0,
+  kUtf8 = 1 << 1,
+  kUtf32Be = 1 << 2,
+  kUtf32Le = 1 << 3,
+  kUtf16Be = 1 << 4,
+  kUtf16Le = 1 << 5,
+  kIso8859_1 = 1 << 6,
+  kExtendedAscii = 1 << 7,
+  kAllCandidates = (1 << 8) - 1,
+};
 
-bool looks_iso8859_1(scnr::Byte c) {
-  return looks_ascii(c) || (160 <= c);
-}
+// The data heuristic decides from the head, files too short to have a few bytes in every lane are left to the
+// text checks
+constexpr size_t kMinDataHead = 64;
+constexpr size_t kMaxDataHead = 16 * 1024;
 
-bool looks_extended_ascii(scnr::Byte c) {
-  return looks_ascii(c) || 128 <= c;
-}
+#define F 0 /* character never appears in text */
+#define T 1 /* character appears in plain ASCII text */
+#define I 2 /* character appears in ISO-8859 text */
+#define X 3 /* character appears in non-ISO extended ASCII (Mac, IBM PC) */
 
-template <typename Func>
-bool looks(scnr::StreamData stream, Func&& func) {
-  scnr::Byte buf[1024];
-  while (auto nbytes = stream.readnext(buf, sizeof(buf))) {
-    for (size_t i = 0; i < nbytes; ++i) {
-      if (!func(buf[i])) {
-        return false;
-      }
-    }
+// Class of every byte value. Printable chars, Bell, Backspace, HT, LineFeed, VT, FormFeed, CR and NEL are ASCII
+// text; the rest of the C1 range is only used by extended ASCII code pages
+constexpr std::uint8_t kTextChars[256] = {
+  F, F, F, F, F, F, F, T, T, T, T, T, T, T, F, F,  /* 0x0X */
+  F, F, F, F, F, F, F, F, F, F, F, F, F, F, F, F,  /* 0x1X */
+  T, T, T, T, T, T, T, T, T, T, T, T, T, T, T, T,  /* 0x2X */
+  T, T, T, T, T, T, T, T, T, T, T, T, T, T, T, T,  /* 0x3X */
+  T, T, T, T, T, T, T, T, T, T, T, T, T, T, T, T,  /* 0x4X */
+  T, T, T, T, T, T, T, T, T, T, T, T, T, T, T, T,  /* 0x5X */
+  T, T, T, T, T, T, T, T, T, T, T, T, T, T, T, T,  /* 0x6X */
+  T, T, T, T, T, T, T, T, T, T, T, T, T, T, T, F,  /* 0x7X */
+  X, X, X, X, X, T, X, X, X, X, X, X, X, X, X, X,  /* 0x8X */
+  X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,  /* 0x9X */
+  I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I,  /* 0xaX */
+  I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I,  /* 0xbX */
+  I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I,  /* 0xcX */
+  I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I,  /* 0xdX */
+  I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I,  /* 0xeX */
+  I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I,  /* 0xfX */
+};
+
+// 8-bit encodings a byte of each class rules out
+constexpr std::uint8_t kClassRulesOut[4] = {
+  /* F */ kAscii | kIso8859_1 | kExtendedAscii,
+  /* T */ 0,
+  /* I */ kAscii,
+  /* X */ kAscii | kIso8859_1,
+};
+
+#undef F
+#undef T
+#undef I
+#undef X
+
+constexpr auto kRulesOut = [] {
+  std::array<std::uint8_t, 256> retval{};
+  for (size_t c = 0; c < retval.size(); ++c) {
+    retval[c] = kClassRulesOut[kTextChars[c]];
   }
-  return true;
-}
+  return retval;
+}();
 
-bool looks_ascii(scnr::StreamData stream) {
-  return looks(stream, static_cast<bool (&)(scnr::Byte)>(looks_ascii));
+bool looks_ascii(scnr::Byte c) {
+  return kRulesOut[c] == 0;
 }
 
-bool looks_iso8859_1(scnr::StreamData stream) {
-  return looks(stream, static_cast<bool (&)(scnr::Byte)>(looks_iso8859_1));
+// 8-bit encodings the data rules out, without a branch per byte
+unsigned ruled_out_8bit(const scnr::Byte* data, size_t size) {
+  // independent accumulators keep the loads apart
+  std::uint8_t acc[4] = {};
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    acc[0] |= kRulesOut[data[i]];
+    acc[1] |= kRulesOut[data[i + 1]];
+    acc[2] |= kRulesOut[data[i + 2]];
+    acc[3] |= kRulesOut[data[i + 3]];
+  }
+  for (; i < size; ++i) {
+    acc[0] |= kRulesOut[data[i]];
+  }
+  return acc[0] | acc[1] | acc[2] | acc[3];
 }
 
-bool looks_extended_ascii(scnr::StreamData stream) {
-  return looks(stream, static_cast<bool (&)(scnr::Byte)>(looks_extended_ascii));
+// C0 controls found in text: whitespace, Bell and Backspace, and the ESC of ANSI escape sequences, e.g. colored
+// logs. U+0000 and the rest would make runs of small binary integers and the NULs of UTF-16 valid
+bool text_control(uint32_t code) {
+  return code < 32 && (looks_ascii(code) || code == 0x1b);
 }
 
-bool valid_ucodepoint(int64_t code) {
-  // check https://stackoverflow.com/questions/27415935/does-unicode-have-a-defined-maximum-number-of-code-points
-
-  // Unicode v15 contains 149186 characters and this number is growing.
-  // Let's check this code in some reasonable limit.
-  return code < 150000;
+// Unicode scalar values, surrogates only exist as UTF-16 code units; of the C0 controls only those of text
+bool valid_ucodepoint(uint32_t code) {
+  return code < 0x110000 && (code & 0xfffff800) != 0xd800 && (code >= 32 || text_control(code));
 }
 
-bool looks_utf8(scnr::StreamData stream) {
-  scnr::Byte buf[1024];
-  // chunksize must be smaller than buffer size so that extra bytes can be read if needed
-  constexpr size_t chunksize = 1000;
-  while (auto nbytes = stream.readnext(buf, chunksize)) {
-    for (size_t i = 0; i < nbytes; ++i) {
-      int blocks = std::countl_one(buf[i]);
+// Validators see the data chunk by chunk, a sequence or code unit may continue in the next chunk
+
+class Utf8Validator {
+ public:
+  bool Feed(const scnr::Byte* data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+      const int blocks = std::countl_one(data[i]);
+      if (pending_ > 0) {
+        if (blocks != 1) {
+          return false;
+        }
+        pending_ -= 1;
+        continue;
+      }
       if (blocks == 0) {
-        // 0xxxxxxx is plain ASCII
-        // looks_ascii(buf[i])?
+        // 0xxxxxxx is plain ASCII, only the controls of text; NUL bytes of UTF-16 text would be valid otherwise
+        if (data[i] < 32 && !text_control(data[i])) {
+          return false;
+        }
         continue;
       }
       if (blocks == 1 || blocks > 4) {
         // invalid UTF-8
         return false;
       }
-      blocks -= 1;
+      pending_ = blocks - 1;
+    }
+    return true;
+  }
 
-      // read some extra
-      if (i + blocks >= nbytes) {
-        // is ok?
-        if (!stream.readnext(buf + chunksize, i + blocks - nbytes + 1)) {
-          // unexpected eof
-          return false;
-        }
+  // unexpected eof inside a sequence
+  bool Finish() const {
+    return pending_ == 0;
+  }
+
+ private:
+  int pending_ = 0;
+};
+
+#if defined(SCNR_SIMD_SSE2) || defined(SCNR_SIMD_NEON)
+// Four code units in either byte order that need no scalar look: scalar values other than C0 controls
+struct Utf32Block {
+  bool be_plain;
+  bool le_plain;
+};
+
+Utf32Block classify_utf32_block(const scnr::Byte* p) {
+  #if defined(SCNR_SIMD_SSE2)
+  const __m128i le = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+  // no byte shuffle in SSE2, the lanes are swapped with shifts
+  const __m128i swapped16 = _mm_or_si128(_mm_slli_epi16(le, 8), _mm_srli_epi16(le, 8));
+  const __m128i be = _mm_or_si128(_mm_slli_epi32(swapped16, 16), _mm_srli_epi32(swapped16, 16));
+  auto plain = [&](__m128i units) {
+    // the shifted value is below 0x10000, the signed compare is fine
+    const __m128i above = _mm_cmpgt_epi32(_mm_srli_epi32(units, 16), _mm_set1_epi32(0x10));
+    const __m128i surrogate =
+      _mm_cmpeq_epi32(_mm_and_si128(units, _mm_set1_epi32(int(0xfffff800))), _mm_set1_epi32(0xd800));
+    const __m128i control =
+      _mm_cmpeq_epi32(_mm_and_si128(units, _mm_set1_epi32(int(0xffffffe0))), _mm_setzero_si128());
+    return _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(above, surrogate), control)) == 0;
+  };
+  return Utf32Block{.be_plain = plain(be), .le_plain = plain(le)};
+  #else
+  const uint8x16_t bytes = vld1q_u8(p);
+  auto plain = [](uint32x4_t units) {
+    const uint32x4_t above = vcgeq_u32(units, vdupq_n_u32(0x110000));
+    const uint32x4_t surrogate = vceqq_u32(vandq_u32(units, vdupq_n_u32(0xfffff800)), vdupq_n_u32(0xd800));
+    const uint32x4_t control = vcltq_u32(units, vdupq_n_u32(0x20));
+    return vmaxvq_u32(vorrq_u32(vorrq_u32(above, surrogate), control)) == 0;
+  };
+  return Utf32Block{.be_plain = plain(vreinterpretq_u32_u8(vrev32q_u8(bytes))),
+                    .le_plain = plain(vreinterpretq_u32_u8(bytes))};
+  #endif
+}
+#endif
+
+// Both byte orders at once, from the same loads; they share the partial unit at the end of a chunk
+class Utf32Validator {
+ public:
+  void Feed(const scnr::Byte* data, size_t size) {
+    size_t i = 0;
+    while (partial_size_ != 0 && i < size) {
+      partial_[partial_size_++] = data[i++];
+      if (partial_size_ == sizeof(partial_)) {
+        Units(partial_, 1);
+        partial_size_ = 0;
       }
-      // int64_t code = 0;
-      while (blocks) {
-        i += 1;
-        if (std::countl_one(buf[i]) != 1) {
-          return false;
-        }
-        blocks -= 1;
+    }
+#if defined(SCNR_SIMD_SSE2) || defined(SCNR_SIMD_NEON)
+    constexpr size_t kBlock = 16;
+    for (; i + kBlock <= size && (be_ok_ || le_ok_); i += kBlock) {
+      const Utf32Block block = classify_utf32_block(data + i);
+      if (be_ok_ && !block.be_plain) {
+        be_ok_ = Units(data + i, kBlock / 4, true);
       }
+      if (le_ok_ && !block.le_plain) {
+        le_ok_ = Units(data + i, kBlock / 4, false);
+      }
+    }
+#endif
+    const size_t units = (size - i) / 4;
+    Units(data + i, units);
+    i += units * 4;
+    while (i < size) {
+      partial_[partial_size_++] = data[i++];
     }
   }
-  return true;
-}
 
-bool looks_utf8_with_BOM(scnr::StreamData stream) {
-  scnr::Byte buf[3];
-  if (stream.read(buf, 0, 3) && buf[0] == 0xef && buf[1] == 0xbb && buf[2] == 0xbf) {
-    return looks_utf8(stream.advanced(3));
+  void Finish() {
+    if (partial_size_ != 0) {
+      be_ok_ = le_ok_ = false;
+    }
   }
-  return 0;
+
+  bool Ok(bool bigendian) const {
+    return bigendian ? be_ok_ : le_ok_;
+  }
+
+ private:
+  void Units(const scnr::Byte* data, size_t count) {
+    be_ok_ = be_ok_ && Units(data, count, true);
+    le_ok_ = le_ok_ && Units(data, count, false);
+  }
+
+  static bool Units(const scnr::Byte* data, size_t count, bool bigendian) {
+    for (size_t i = 0; i < count; ++i) {
+      const scnr::Byte* buf = data + 4 * i;
+      const uint32_t code = bigendian ? uint32_t{buf[0]} << 0x18 | buf[1] << 0x10 | buf[2] << 0x8 | buf[3]
+                                      : uint32_t{buf[3]} << 0x18 | buf[2] << 0x10 | buf[1] << 0x8 | buf[0];
+      if (!valid_ucodepoint(code)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  scnr::Byte partial_[4];
+  size_t partial_size_ = 0;
+  bool be_ok_ = true;
+  bool le_ok_ = true;
+};
+
+#if defined(SCNR_SIMD_SSE2) || defined(SCNR_SIMD_NEON)
+// Eight code units that need no scalar look: no surrogates, no noncharacters U+FFFE and U+FFFF, no C0 controls
+struct Utf16Block {
+  bool plain;
+  // units in U+0000..U+00FF
+  int latin;
+};
+
+Utf16Block classify_utf16_block(const scnr::Byte* p, bool bigendian) {
+  #if defined(SCNR_SIMD_SSE2)
+  __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+  if (bigendian) {
+    units = _mm_or_si128(_mm_slli_epi16(units, 8), _mm_srli_epi16(units, 8));
+  }
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i surrogate =
+    _mm_cmpeq_epi16(_mm_and_si128(units, _mm_set1_epi16(short(0xf800))), _mm_set1_epi16(short(0xd800)));
+  const __m128i nonchar = _mm_cmpeq_epi16(_mm_or_si128(units, _mm_set1_epi16(1)), _mm_set1_epi16(short(0xffff)));
+  const __m128i control = _mm_cmpeq_epi16(_mm_and_si128(units, _mm_set1_epi16(short(0xffe0))), zero);
+  const __m128i latin = _mm_cmpeq_epi16(_mm_and_si128(units, _mm_set1_epi16(short(0xff00))), zero);
+  return Utf16Block{.plain = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(surrogate, nonchar), control)) == 0,
+                    .latin = std::popcount(static_cast<unsigned>(_mm_movemask_epi8(latin))) / 2};
+  #else
+  uint8x16_t bytes = vld1q_u8(p);
+  if (bigendian) {
+    bytes = vrev16q_u8(bytes);
+  }
+  const uint16x8_t units = vreinterpretq_u16_u8(bytes);
+  const uint16x8_t surrogate = vceqq_u16(vandq_u16(units, vdupq_n_u16(0xf800)), vdupq_n_u16(0xd800));
+  const uint16x8_t nonchar = vcgeq_u16(units, vdupq_n_u16(0xfffe));
+  const uint16x8_t control = vcltq_u16(units, vdupq_n_u16(0x20));
+  const uint16x8_t latin = vcltq_u16(units, vdupq_n_u16(0x100));
+  return Utf16Block{.plain = vmaxvq_u16(vorrq_u16(vorrq_u16(surrogate, nonchar), control)) == 0,
+                    .latin = vaddvq_u16(vshrq_n_u16(latin, 15))};
+  #endif
 }
+#endif
 
-bool looks_utf32(scnr::StreamData stream, bool bigendian) {
-  scnr::Byte buf[1024];
-  while (auto nbytes = stream.readnext(buf, sizeof(buf))) {
-    if (nbytes % 4 != 0) {
-      return {};
+// Both byte orders at once. Surrogates must come in high-low pairs; C0 controls other than those of text and
+// the noncharacters U+FFFE and U+FFFF are not text, the latter is what a BOM of the other byte order reads as
+class Utf16Validator {
+ public:
+  void Feed(const scnr::Byte* data, size_t size) {
+    size_t i = 0;
+    if (partial_size_ != 0 && size > 0) {
+      const scnr::Byte unit[2] = {partial_, data[0]};
+      Units(unit, 1);
+      partial_size_ = 0;
+      i = 1;
     }
-    for (int i = 0; i < nbytes; i += 4) {
-      uint64_t code = 0;
-      if (bigendian) {
-        code = buf[i + 0] << 0x18 | buf[i + 1] << 0x10 | buf[i + 2] << 0x8 | buf[i + 3] << 0x0;
-      } else {
-        code = buf[i + 0] << 0x0 | buf[i + 1] << 0x8 | buf[i + 2] << 0x10 | buf[i + 3] << 0x18;
+#if defined(SCNR_SIMD_SSE2) || defined(SCNR_SIMD_NEON)
+    constexpr size_t kBlock = 16;
+    for (; i + kBlock <= size && (be_.ok || le_.ok); i += kBlock) {
+      for (auto* order : {&be_, &le_}) {
+        if (!order->ok) {
+          continue;
+        }
+        const Utf16Block block = classify_utf16_block(data + i, order == &be_);
+        if (block.plain && !order->pending) {
+          order->latin += block.latin;
+        } else {
+          Units(data + i, kBlock / 2, *order, order == &be_);
+        }
       }
-      if (!valid_ucodepoint(code)) {
-        return false;
+    }
+#endif
+    const size_t units = (size - i) / 2;
+    Units(data + i, units);
+    i += units * 2;
+    if (i < size) {
+      partial_ = data[i];
+      partial_size_ = 1;
+    }
+  }
+
+  void Finish() {
+    if (partial_size_ != 0) {
+      be_.ok = le_.ok = false;
+    }
+    for (auto* order : {&be_, &le_}) {
+      order->ok = order->ok && !order->pending;
+    }
+  }
+
+  bool Ok(bool bigendian) const {
+    return bigendian ? be_.ok : le_.ok;
+  }
+
+  // Units in U+0000..U+00FF, text shows spaces and newlines at least; text of other encodings does not have
+  // the NUL bytes for them
+  uint64_t Latin(bool bigendian) const {
+    return bigendian ? be_.latin : le_.latin;
+  }
+
+ private:
+  struct Order {
+    bool ok = true;
+    // a high surrogate waits for its low one
+    bool pending = false;
+    uint64_t latin = 0;
+  };
+
+  void Units(const scnr::Byte* data, size_t count) {
+    for (auto* order : {&be_, &le_}) {
+      if (order->ok) {
+        Units(data, count, *order, order == &be_);
       }
     }
   }
-  return true;
+
+  static void Units(const scnr::Byte* data, size_t count, Order& order, bool bigendian) {
+    for (size_t i = 0; i < count && order.ok; ++i) {
+      const scnr::Byte hi = data[2 * i + (bigendian ? 0 : 1)];
+      const scnr::Byte lo = data[2 * i + (bigendian ? 1 : 0)];
+      const bool high_surrogate = (hi & 0xfc) == 0xd8;
+      const bool low_surrogate = (hi & 0xfc) == 0xdc;
+      if (order.pending) {
+        order.ok = low_surrogate;
+        order.pending = false;
+      } else if (high_surrogate) {
+        order.pending = true;
+      } else if (low_surrogate || (hi == 0xff && lo >= 0xfe) || (hi == 0 && lo < 32 && !text_control(lo))) {
+        order.ok = false;
+      }
+      order.latin += hi == 0;
+    }
+  }
+
+  Order be_;
+  Order le_;
+  scnr::Byte partial_ = 0;
+  size_t partial_size_ = 0;
+};
+
+// Runs every encoding check over each chunk while it is in cache, the data is read once. Encodings drop out
+// as soon as the data contradicts them
+class TextClassifier {
+ public:
+  // Returns false once no encoding is left, the rest of the data need not be read
+  bool Feed(const scnr::Byte* data, size_t size) {
+    if (candidates_ & (kAscii | kIso8859_1 | kExtendedAscii)) {
+      candidates_ &= ~ruled_out_8bit(data, size);
+    }
+    if ((candidates_ & kUtf8) && !utf8_.Feed(data, size)) {
+      candidates_ &= ~kUtf8;
+    }
+    if (candidates_ & (kUtf32Be | kUtf32Le)) {
+      utf32_.Feed(data, size);
+      Update();
+    }
+    if (candidates_ & (kUtf16Be | kUtf16Le)) {
+      utf16_.Feed(data, size);
+      Update();
+    }
+    return candidates_ != 0;
+  }
+
+  // Encodings the data is valid in. Data cut off by a limit may end inside a sequence or code unit
+  unsigned Finish(bool truncated) {
+    if (!truncated) {
+      if (!utf8_.Finish()) {
+        candidates_ &= ~kUtf8;
+      }
+      utf32_.Finish();
+      utf16_.Finish();
+    }
+    Update();
+    return candidates_;
+  }
+
+  uint64_t Utf16Latin(bool bigendian) const {
+    return utf16_.Latin(bigendian);
+  }
+
+ private:
+  void Update() {
+    const std::pair<Candidate, bool> orders[] = {{kUtf32Be, utf32_.Ok(true)},
+                                                 {kUtf32Le, utf32_.Ok(false)},
+                                                 {kUtf16Be, utf16_.Ok(true)},
+                                                 {kUtf16Le, utf16_.Ok(false)}};
+    for (auto [candidate, ok] : orders) {
+      if (!ok) {
+        candidates_ &= ~candidate;
+      }
+    }
+  }
+
+  unsigned candidates_ = kAllCandidates;
+  Utf8Validator utf8_;
+  Utf32Validator utf32_;
+  Utf16Validator utf16_;
+};
+
+// NUL bytes of each lane, the offsets of the same remainder modulo 4
+std::array<size_t, 4> count_nul_lanes(const scnr::Byte* data, size_t size) {
+  std::array<size_t, 4> retval{};
+  size_t i = 0;
+#if defined(SCNR_SIMD_SSE2) || defined(SCNR_SIMD_NEON)
+  // a vector covers every lane four times; its byte counters are summed up before they could wrap
+  constexpr size_t kBlock = 16;
+  constexpr size_t kMaxBlocks = 255;
+  while (i + kBlock <= size) {
+    const size_t blocks = std::min(kMaxBlocks, (size - i) / kBlock);
+    alignas(16) scnr::Byte counters[kBlock];
+  #if defined(SCNR_SIMD_SSE2)
+    __m128i acc = _mm_setzero_si128();
+    for (size_t b = 0; b < blocks; ++b, i += kBlock) {
+      const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+      // a match is 0xff, subtracting it counts one
+      acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(bytes, _mm_setzero_si128()));
+    }
+    _mm_store_si128(reinterpret_cast<__m128i*>(counters), acc);
+  #else
+    uint8x16_t acc = vdupq_n_u8(0);
+    for (size_t b = 0; b < blocks; ++b, i += kBlock) {
+      acc = vsubq_u8(acc, vceqq_u8(vld1q_u8(data + i), vdupq_n_u8(0)));
+    }
+    vst1q_u8(counters, acc);
+  #endif
+    for (size_t lane = 0; lane < kBlock; ++lane) {
+      retval[lane % 4] += counters[lane];
+    }
+  }
+#endif
+  for (; i < size; ++i) {
+    retval[i % 4] += data[i] == 0;
+  }
+  return retval;
 }
 
-bool looks_utf32_with_BOM(scnr::StreamData stream, bool bigendian) {
+// Byte order mark at the start of the data, as encoding candidate
+unsigned bom_of(scnr::StreamData stream) {
   scnr::Byte buf[4];
-  if (!stream.read(buf, 0, 4)) {
-    return false;
+  const size_t nbytes = stream.readsome(buf, 0, sizeof(buf));
+  if (nbytes >= 3 && buf[0] == 0xef && buf[1] == 0xbb && buf[2] == 0xbf) {
+    return kUtf8;
   }
-  if (bigendian && buf[0] == 0 && buf[1] == 0 && buf[2] == 0xfe && buf[3] == 0xff &&
-      looks_utf32(stream.advanced(4), bigendian)) {
-    return true;
+  if (nbytes == 4 && buf[0] == 0 && buf[1] == 0 && buf[2] == 0xfe && buf[3] == 0xff) {
+    return kUtf32Be;
   }
-  if (not bigendian && buf[0] == 0xff && buf[1] == 0xfe && buf[2] == 0 && buf[3] == 0 &&
-      looks_utf32(stream.advanced(4), bigendian)) {
-    return true;
+  if (nbytes == 4 && buf[0] == 0xff && buf[1] == 0xfe && buf[2] == 0 && buf[3] == 0) {
+    return kUtf32Le;
+  }
+  if (nbytes >= 2 && buf[0] == 0xfe && buf[1] == 0xff) {
+    return kUtf16Be;
   }
-  return false;
+  if (nbytes >= 2 && buf[0] == 0xff && buf[1] == 0xfe) {
+    return kUtf16Le;
+  }
+  return 0;
 }
 
-#define F 0 /* character never appears in text */
-#define T 1 /* character appears in plain ASCII text */
-#define I 2 /* character appears in ISO-8859 text */
-#define X 3 /* character appears in non-ISO extended ASCII (Mac, IBM PC) */
-
 }  // namespace
 
 namespace scnr {
 
-std::optional<TxtFile> try_txt(scnr::StreamData stream) {
-  TxtFile txtfile;
-  if (looks_ascii(stream)) {
-    txtfile.encoding = "ASCII";
-  } else if (looks_utf8_with_BOM(stream)) {
-    txtfile.encoding = "UTF-8";
-    txtfile.withbom = true;
-  } else if (looks_utf8(stream)) {
-    txtfile.encoding = "UTF-8";
-  } else if (looks_utf32_with_BOM(stream, true)) {
-    txtfile.encoding = "UTF-32-BE";
-    txtfile.withbom = true;
-  } else if (looks_utf32_with_BOM(stream, false)) {
-    txtfile.encoding = "UTF-32-LE";
-    txtfile.withbom = true;
-  } else if (looks_utf32(stream, true)) {
-    txtfile.encoding = "UTF-32-BE";
-  } else if (looks_utf32(stream, false)) {
-    txtfile.encoding = "UTF-32-LE";
-  } else if (looks_iso8859_1(stream)) {
-    txtfile.encoding = "iso-8859-1";
-  } else if (looks_extended_ascii(stream)) {
-    txtfile.encoding = "extended ascii";
-  } else {
+std::optional<DataFile> try_data(scnr::StreamData stream, const DataHeuristic& heuristic) {
+  Byte buf[kMaxDataHead];
+  const size_t nbytes = stream.readsome(buf, 0, std::min(heuristic.head, sizeof(buf)));
+  if (nbytes < kMinDataHead) {
     return {};
   }
-  return txtfile;
+  const auto nuls = count_nul_lanes(buf, nbytes);
+  for (size_t lane = 0; lane < nuls.size(); ++lane) {
+    const size_t lane_size = (nbytes - lane + 3) / 4;
+    if (nuls[lane] * 100 < lane_size * heuristic.nul_percent) {
+      return {};
+    }
+  }
+  return DataFile{};
+}
+
+std::optional<TxtFile> try_txt(scnr::StreamData stream) {
+  return try_txt(stream, std::numeric_limits<size_t>::max());
+}
+
+std::optional<TxtFile> try_txt(scnr::StreamData stream, size_t max_bytes) {
+  TextClassifier classifier;
+  Byte buf[4096];
+  size_t total = 0;
+  while (total < max_bytes) {
+    const size_t nbytes = stream.readsome(buf, total, std::min(sizeof(buf), max_bytes - total));
+    if (nbytes == 0) {
+      break;
+    }
+    stream.poll();
+    if (!classifier.Feed(buf, nbytes)) {
+      return {};
+    }
+    total += nbytes;
+  }
+  Byte next;
+  const bool truncated = total == max_bytes && stream.readsome(&next, total, 1) == 1;
+  unsigned candidates = classifier.Finish(truncated);
+  const unsigned bom = bom_of(stream);
+
+  // in order of preference, the encoding of a byte order mark goes first
+  constexpr std::pair<Candidate, std::string_view> kEncodings[] = {
+    {kAscii, "ASCII"},          {kUtf8, "UTF-8"},         {kUtf32Be, "UTF-32-BE"},
+    {kUtf32Le, "UTF-32-LE"},    {kUtf16Be, "UTF-16-BE"},  {kUtf16Le, "UTF-16-LE"},
+    {kIso8859_1, "iso-8859-1"}, {kExtendedAscii, "extended ascii"},
+  };
+  for (auto [candidate, encoding] : kEncodings) {
+    if ((candidates & bom & candidate) != 0) {
+      return TxtFile{.encoding = encoding, .withbom = true};
+    }
+  }
+  // without BOM, UTF-16 needs units in U+0000..U+00FF; the byte order with more of them wins, little-endian
+  // on a tie
+  const uint64_t be_latin = (candidates & kUtf16Be) ? classifier.Utf16Latin(true) : 0;
+  const uint64_t le_latin = (candidates & kUtf16Le) ? classifier.Utf16Latin(false) : 0;
+  if (be_latin == 0 || be_latin <= le_latin) {
+    candidates &= ~kUtf16Be;
+  }
+  if (le_latin == 0 || le_latin < be_latin) {
+    candidates &= ~kUtf16Le;
+  }
+  for (auto [candidate, encoding] : kEncodings) {
+    if ((candidates & candidate) != 0) {
+      return TxtFile{.encoding = encoding};
+    }
+  }
+  return {};
 }
 
-}  // namespace scnr
\ No newline at end of file
+}  // namespace scnr
@@ -1,58 +1,181 @@
 #include <scnr/file.hpp>
+#include <scnr/name_table.hpp>
 #include <scnr/parse_mach-o.hpp>
 #include <scnr/util.hpp>
 
+#include <cstddef>
 #include <cstring>
+#include <string>
 #include <string_view>
+#include <vector>
 
 #include <scnr/mach-o/fat.h>
 #include <scnr/mach-o/loader.h>
 
 namespace {
-std::string_view CpuTypeAsSV(cpu_type_t cputype) {
-  std::string_view retval;
-#define SCNR_CASE_MACRO(code)                                                                                          \
-  case code:                                                                                                           \
-    retval = #code;                                                                                                    \
-    break
-
-  switch (cputype) {
-    SCNR_CASE_MACRO(CPU_TYPE_ANY);
-    SCNR_CASE_MACRO(CPU_TYPE_VAX);
-    SCNR_CASE_MACRO(CPU_TYPE_MC680x0);
-    SCNR_CASE_MACRO(CPU_TYPE_X86);
-    SCNR_CASE_MACRO(CPU_TYPE_X86_64);
-    SCNR_CASE_MACRO(CPU_TYPE_MC98000);
-    SCNR_CASE_MACRO(CPU_TYPE_HPPA);
-    SCNR_CASE_MACRO(CPU_TYPE_ARM);
-    SCNR_CASE_MACRO(CPU_TYPE_ARM64);
-    SCNR_CASE_MACRO(CPU_TYPE_ARM64_32);
-    SCNR_CASE_MACRO(CPU_TYPE_MC88000);
-    SCNR_CASE_MACRO(CPU_TYPE_SPARC);
-    SCNR_CASE_MACRO(CPU_TYPE_I860);
-    SCNR_CASE_MACRO(CPU_TYPE_POWERPC);
-    SCNR_CASE_MACRO(CPU_TYPE_POWERPC64);
+// cputype values of the header
+constexpr scnr::NamedValue<cpu_type_t> kCpuTypes[] = {
+  SCNR_NAMED(CPU_TYPE_ANY),
+  SCNR_NAMED(CPU_TYPE_VAX),
+  SCNR_NAMED(CPU_TYPE_MC680x0),
+  SCNR_NAMED(CPU_TYPE_X86),
+  SCNR_NAMED(CPU_TYPE_X86_64),
+  SCNR_NAMED(CPU_TYPE_MC98000),
+  SCNR_NAMED(CPU_TYPE_HPPA),
+  SCNR_NAMED(CPU_TYPE_ARM),
+  SCNR_NAMED(CPU_TYPE_ARM64),
+  SCNR_NAMED(CPU_TYPE_ARM64_32),
+  SCNR_NAMED(CPU_TYPE_MC88000),
+  SCNR_NAMED(CPU_TYPE_SPARC),
+  SCNR_NAMED(CPU_TYPE_I860),
+  SCNR_NAMED(CPU_TYPE_POWERPC),
+  SCNR_NAMED(CPU_TYPE_POWERPC64),
+};
+constexpr scnr::NameTable kCpuTypeNames(kCpuTypes, "CPU_TYPE_");
+
+// Subtypes are numbered per CPU type, the key combines both. The capability bits of the subtype, e.g. the
+// pointer authentication ABI version of arm64e, are not part of it
+constexpr uint64_t SubtypeKey(cpu_type_t cputype, cpu_subtype_t cpusubtype) {
+  return uint64_t{static_cast<uint32_t>(cputype)} << 32 | (static_cast<uint32_t>(cpusubtype) & ~CPU_SUBTYPE_MASK);
+}
+
+#define SCNR_SUBTYPE(cputype, code) {SubtypeKey(cputype, code), #code}
+constexpr scnr::NamedValue<uint64_t> kCpuSubtypes[] = {
+  SCNR_SUBTYPE(CPU_TYPE_X86, CPU_SUBTYPE_X86_ALL),
+  SCNR_SUBTYPE(CPU_TYPE_X86, CPU_SUBTYPE_X86_ARCH1),
+  SCNR_SUBTYPE(CPU_TYPE_X86_64, CPU_SUBTYPE_X86_64_ALL),
+  SCNR_SUBTYPE(CPU_TYPE_X86_64, CPU_SUBTYPE_X86_64_H),
+  SCNR_SUBTYPE(CPU_TYPE_ARM, CPU_SUBTYPE_ARM_ALL),
+  SCNR_SUBTYPE(CPU_TYPE_ARM, CPU_SUBTYPE_ARM_V4T),
+  SCNR_SUBTYPE(CPU_TYPE_ARM, CPU_SUBTYPE_ARM_V6),
+  SCNR_SUBTYPE(CPU_TYPE_ARM, CPU_SUBTYPE_ARM_V5TEJ),
+  SCNR_SUBTYPE(CPU_TYPE_ARM, CPU_SUBTYPE_ARM_XSCALE),
+  SCNR_SUBTYPE(CPU_TYPE_ARM, CPU_SUBTYPE_ARM_V7),
+  SCNR_SUBTYPE(CPU_TYPE_ARM, CPU_SUBTYPE_ARM_V7F),
+  SCNR_SUBTYPE(CPU_TYPE_ARM, CPU_SUBTYPE_ARM_V7S),
+  SCNR_SUBTYPE(CPU_TYPE_ARM, CPU_SUBTYPE_ARM_V7K),
+  SCNR_SUBTYPE(CPU_TYPE_ARM, CPU_SUBTYPE_ARM_V8),
+  SCNR_SUBTYPE(CPU_TYPE_ARM, CPU_SUBTYPE_ARM_V6M),
+  SCNR_SUBTYPE(CPU_TYPE_ARM, CPU_SUBTYPE_ARM_V7M),
+  SCNR_SUBTYPE(CPU_TYPE_ARM, CPU_SUBTYPE_ARM_V7EM),
+  SCNR_SUBTYPE(CPU_TYPE_ARM, CPU_SUBTYPE_ARM_V8M),
+  SCNR_SUBTYPE(CPU_TYPE_ARM64, CPU_SUBTYPE_ARM64_ALL),
+  SCNR_SUBTYPE(CPU_TYPE_ARM64, CPU_SUBTYPE_ARM64_V8),
+  SCNR_SUBTYPE(CPU_TYPE_ARM64, CPU_SUBTYPE_ARM64E),
+  SCNR_SUBTYPE(CPU_TYPE_ARM64_32, CPU_SUBTYPE_ARM64_32_ALL),
+  SCNR_SUBTYPE(CPU_TYPE_ARM64_32, CPU_SUBTYPE_ARM64_32_V8),
+  SCNR_SUBTYPE(CPU_TYPE_POWERPC, CPU_SUBTYPE_POWERPC_ALL),
+  SCNR_SUBTYPE(CPU_TYPE_POWERPC, CPU_SUBTYPE_POWERPC_601),
+  SCNR_SUBTYPE(CPU_TYPE_POWERPC, CPU_SUBTYPE_POWERPC_602),
+  SCNR_SUBTYPE(CPU_TYPE_POWERPC, CPU_SUBTYPE_POWERPC_603),
+  SCNR_SUBTYPE(CPU_TYPE_POWERPC, CPU_SUBTYPE_POWERPC_603e),
+  SCNR_SUBTYPE(CPU_TYPE_POWERPC, CPU_SUBTYPE_POWERPC_603ev),
+  SCNR_SUBTYPE(CPU_TYPE_POWERPC, CPU_SUBTYPE_POWERPC_604),
+  SCNR_SUBTYPE(CPU_TYPE_POWERPC, CPU_SUBTYPE_POWERPC_604e),
+  SCNR_SUBTYPE(CPU_TYPE_POWERPC, CPU_SUBTYPE_POWERPC_620),
+  SCNR_SUBTYPE(CPU_TYPE_POWERPC, CPU_SUBTYPE_POWERPC_750),
+  SCNR_SUBTYPE(CPU_TYPE_POWERPC, CPU_SUBTYPE_POWERPC_7400),
+  SCNR_SUBTYPE(CPU_TYPE_POWERPC, CPU_SUBTYPE_POWERPC_7450),
+  SCNR_SUBTYPE(CPU_TYPE_POWERPC, CPU_SUBTYPE_POWERPC_970),
+  SCNR_SUBTYPE(CPU_TYPE_POWERPC64, CPU_SUBTYPE_POWERPC_ALL),
+  SCNR_SUBTYPE(CPU_TYPE_POWERPC64, CPU_SUBTYPE_POWERPC_970),
+};
+#undef SCNR_SUBTYPE
+constexpr scnr::NameTable kCpuSubtypeNames(kCpuSubtypes, "CPU_SUBTYPE_");
+
+// PLATFORM_* values of LC_BUILD_VERSION
+constexpr scnr::NamedValue<uint32_t> kPlatforms[] = {
+  SCNR_NAMED(PLATFORM_MACOS),
+  SCNR_NAMED(PLATFORM_IOS),
+  SCNR_NAMED(PLATFORM_TVOS),
+  SCNR_NAMED(PLATFORM_WATCHOS),
+  SCNR_NAMED(PLATFORM_BRIDGEOS),
+  SCNR_NAMED(PLATFORM_MACCATALYST),
+  SCNR_NAMED(PLATFORM_IOSSIMULATOR),
+  SCNR_NAMED(PLATFORM_TVOSSIMULATOR),
+  SCNR_NAMED(PLATFORM_WATCHOSSIMULATOR),
+  SCNR_NAMED(PLATFORM_DRIVERKIT),
+};
+constexpr scnr::NameTable kPlatformNames(kPlatforms, "PLATFORM_");
+
+// LC_VERSION_MIN_* predate LC_BUILD_VERSION and name the platform by the command
+std::string_view VersionMinPlatform(uint32_t cmd) {
+  switch (cmd) {
+    case LC_VERSION_MIN_MACOSX:
+      return kPlatformNames[PLATFORM_MACOS];
+    case LC_VERSION_MIN_IPHONEOS:
+      return kPlatformNames[PLATFORM_IOS];
+    case LC_VERSION_MIN_TVOS:
+      return kPlatformNames[PLATFORM_TVOS];
+    case LC_VERSION_MIN_WATCHOS:
+      return kPlatformNames[PLATFORM_WATCHOS];
     default:
       return {};
   }
-#undef SCNR_MACRO_CASE
+}
 
-  retval.remove_prefix(std::strlen("CPU_TYPE_"));
+// X.Y.Z encoded in nibbles xxxx.yy.zz, the patch level is left out when it is 0
+std::string VersionAsString(uint32_t version) {
+  std::string retval = std::to_string(version >> 16) + "." + std::to_string((version >> 8) & 0xff);
+  if (version & 0xff) {
+    retval += "." + std::to_string(version & 0xff);
+  }
   return retval;
 }
 
-std::optional<scnr::MachOSingle> parse_single(scnr::StreamData stream) {
+std::string UuidAsString(const uint8_t (&uuid)[16]) {
+  static constexpr char kHex[] = "0123456789ABCDEF";
+  std::string retval;
+  for (size_t i = 0; i < sizeof(uuid); ++i) {
+    if (i == 4 || i == 6 || i == 8 || i == 10) {
+      retval.push_back('-');
+    }
+    retval.push_back(kHex[uuid[i] >> 4]);
+    retval.push_back(kHex[uuid[i] & 0xf]);
+  }
+  return retval;
+}
+
+// Path strings of load commands follow the fixed part at an offset given in the command, padded with zeros
+// to cmdsize. Unterminated strings are dropped
+std::string CommandString(const scnr::Byte* cmd, uint32_t cmdsize, uint32_t offset) {
+  if (offset >= cmdsize) {
+    return {};
+  }
+  auto begin = reinterpret_cast<const char*>(cmd + offset);
+  auto end = static_cast<const char*>(std::memchr(begin, '\0', cmdsize - offset));
+  return end ? std::string(begin, end) : std::string();
+}
+
+// Real binaries have at most a few hundred load commands in well under a megabyte
+constexpr uint32_t kMaxLoadCommands = 4096;
+constexpr uint32_t kMaxLoadCommandsSize = 1024 * 1024;
+// There are fewer CPU types than that; Java class files share the fat magic and have a larger
+// major version in place of nfat_arch
+constexpr uint32_t kMaxFatArchs = 32;
+// Budget for the whole file including all slices of a fat binary
+constexpr size_t kMaxHeaderReads = 128;
+constexpr size_t kMaxHeaderBytes = 2 * 1024 * 1024;
+// The first read of a slice covers the header and, for most binaries, all load commands;
+// it also covers the fat header with the largest accepted arch table
+constexpr size_t kHeadSize = 8 * 1024;
+// lc_str offset inside dylib_command, after cmd and cmdsize
+constexpr size_t kDylibNameOffset = 2 * sizeof(uint32_t);
+static_assert(kHeadSize >= sizeof(fat_header) + kMaxFatArchs * sizeof(fat_arch));
+
+std::optional<scnr::MachOSingle> parse_single(scnr::StreamData stream, const scnr::ReadBudget& budget,
+                                              const scnr::Byte* head, size_t head_size) {
   uint32_t magic;
-  if (!stream.readAs(0, magic)) {
+  if (head_size < sizeof(magic)) {
     return {};
   }
+  std::memcpy(&magic, head, sizeof(magic));
   mach_header header32;
   mach_header_64 header64;
 
   size_t read_bytes = 0;
   scnr::MachOSingle retval;
   bool diff_endian = false;
-  bool fat = false;
   bool w64 = true;
 
   switch (magic) {
@@ -60,9 +183,10 @@ std::optional<scnr::MachOSingle> parse_single(scnr::StreamData stream) {
       diff_endian = true;
       [[fallthrough]];
     case MH_MAGIC:
-      if (!stream.readAs(read_bytes, header32)) {
+      if (head_size < sizeof(header32)) {
         return {};
       }
+      std::memcpy(&header32, head, sizeof(header32));
       w64 = false;
 
       break;
@@ -71,9 +195,10 @@ std::optional<scnr::MachOSingle> parse_single(scnr::StreamData stream) {
       [[fallthrough]];
 
     case MH_MAGIC_64:
-      if (!stream.readAs(read_bytes, header64)) {
+      if (head_size < sizeof(header64)) {
         return {};
       }
+      std::memcpy(&header64, head, sizeof(header64));
       w64 = true;
       break;
 
@@ -83,49 +208,132 @@ std::optional<scnr::MachOSingle> parse_single(scnr::StreamData stream) {
   read_bytes += w64 ? sizeof(mach_header_64) : sizeof(mach_header);
 
   auto cputype = w64 ? header64.cputype : header32.cputype;
+  auto cpusubtype = w64 ? header64.cpusubtype : header32.cpusubtype;
   if (diff_endian) {
     cputype = scnr::rev_bytes(cputype);
+    cpusubtype = scnr::rev_bytes(cpusubtype);
   }
 
   retval.w64 = w64;
   retval.endian = scnr::GetEndian(diff_endian);
-  retval.cputype = CpuTypeAsSV(cputype);
+  retval.cputype = kCpuTypeNames[cputype];
+  retval.cpusubtype = kCpuSubtypeNames[SubtypeKey(cputype, cpusubtype)];
 
   auto ncmds = w64 ? header64.ncmds : header32.ncmds;
+  auto sizeofcmds = w64 ? header64.sizeofcmds : header32.sizeofcmds;
   if (diff_endian) {
     ncmds = scnr::rev_bytes(ncmds);
+    sizeofcmds = scnr::rev_bytes(sizeofcmds);
+  }
+  if (ncmds > kMaxLoadCommands || sizeofcmds > kMaxLoadCommandsSize) {
+    return retval;
   }
 
+  // the whole load command region is walked in memory, fetched with one more read if the head missed it
+  const scnr::Byte* cmds = head + read_bytes;
+  std::vector<scnr::Byte> region;
+  if (read_bytes + sizeofcmds > head_size) {
+    region.resize(sizeofcmds);
+    if (!stream.read(region.data(), read_bytes, sizeofcmds)) {
+      if (budget.Exhausted()) {
+        return retval;
+      }
+      return {};
+    }
+    cmds = region.data();
+  }
+
+  size_t cmd_offset = 0;
   for (uint32_t i = 0; i < ncmds; ++i) {
     load_command lc;
-    if (!stream.readAs(read_bytes, lc)) {
-      return {};
+    if (cmd_offset + sizeof(lc) > sizeofcmds) {
+      // ncmds disagrees with sizeofcmds
+      return retval;
     }
+    std::memcpy(&lc, cmds + cmd_offset, sizeof(lc));
     auto lc_cmd = diff_endian ? scnr::rev_bytes(lc.cmd) : lc.cmd;
     auto lc_cmdsize = diff_endian ? scnr::rev_bytes(lc.cmdsize) : lc.cmdsize;
+    // a command must at least cover its own header and stay within sizeofcmds, cmdsize 0 would loop in place
+    if (lc_cmdsize < sizeof(lc) || lc_cmdsize > sizeofcmds - cmd_offset) {
+      return retval;
+    }
 
-    if (lc_cmd == LC_CODE_SIGNATURE) {
-      linkedit_data_command le_data_cmd_sign;
-      if (!stream.readAs(read_bytes, le_data_cmd_sign)) {
-        return {};
-      }
-      auto dataoff = diff_endian ? scnr::rev_bytes(le_data_cmd_sign.dataoff) : le_data_cmd_sign.dataoff;
-      auto datasize = diff_endian ? scnr::rev_bytes(le_data_cmd_sign.datasize) : le_data_cmd_sign.datasize;
-      retval.issigned = true;
+    const scnr::Byte* cmd = cmds + cmd_offset;
+    auto field = [&](size_t offset) {
+      uint32_t value;
+      std::memcpy(&value, cmd + offset, sizeof(value));
+      return diff_endian ? scnr::rev_bytes(value) : value;
+    };
+    switch (lc_cmd) {
+      case LC_CODE_SIGNATURE:
+        if (lc_cmdsize >= sizeof(linkedit_data_command)) {
+          retval.issigned = true;
+          retval.details.signature_size = field(offsetof(linkedit_data_command, datasize));
+        }
+        break;
+      // dylib_command is not memcpy-ed, lc_str has a pointer member on hosts without __LP64__
+      case LC_LOAD_DYLIB:
+      case LC_LOAD_WEAK_DYLIB:
+      case LC_REEXPORT_DYLIB:
+      case LC_LAZY_LOAD_DYLIB:
+      case LC_LOAD_UPWARD_DYLIB:
+      case LC_ID_DYLIB:
+        if (lc_cmdsize >= kDylibNameOffset + sizeof(uint32_t)) {
+          auto name = CommandString(cmd, lc_cmdsize, field(kDylibNameOffset));
+          if (lc_cmd == LC_ID_DYLIB) {
+            retval.details.id = std::move(name);
+          } else if (!name.empty()) {
+            retval.details.dylibs.push_back(std::move(name));
+          }
+        }
+        break;
+      case LC_UUID:
+        if (lc_cmdsize >= sizeof(uuid_command)) {
+          uuid_command uuid;
+          std::memcpy(&uuid, cmd, sizeof(uuid));
+          retval.details.uuid = UuidAsString(uuid.uuid);
+        }
+        break;
+      case LC_BUILD_VERSION:
+        if (lc_cmdsize >= sizeof(build_version_command)) {
+          retval.platform = kPlatformNames[field(offsetof(build_version_command, platform))];
+          retval.details.minos = VersionAsString(field(offsetof(build_version_command, minos)));
+        }
+        break;
+      case LC_VERSION_MIN_MACOSX:
+      case LC_VERSION_MIN_IPHONEOS:
+      case LC_VERSION_MIN_TVOS:
+      case LC_VERSION_MIN_WATCHOS:
+        // LC_BUILD_VERSION wins when a binary has both
+        if (lc_cmdsize >= sizeof(version_min_command) && retval.details.minos.empty()) {
+          retval.platform = VersionMinPlatform(lc_cmd);
+          retval.details.minos = VersionAsString(field(offsetof(version_min_command, version)));
+        }
+        break;
+      default:
+        break;
     }
 
-    read_bytes += lc_cmdsize;
+    cmd_offset += lc_cmdsize;
   }
 
   return retval;
 }
 
-std::optional<scnr::MachOFat> parse_fat(scnr::StreamData stream) {
+std::optional<scnr::MachOSingle> parse_single(scnr::StreamData stream, const scnr::ReadBudget& budget) {
+  scnr::Byte head[kHeadSize];
+  auto nbytes = stream.readsome(head, 0, sizeof(head));
+  return parse_single(stream, budget, head, nbytes);
+}
+
+std::optional<scnr::MachOFat> parse_fat(scnr::StreamData stream, const scnr::ReadBudget& budget,
+                                        const scnr::Byte* head, size_t head_size) {
   size_t read_bytes = 0;
   fat_header header;
-  if (!stream.readAs(read_bytes, header)) {
+  if (head_size < sizeof(header)) {
     return {};
   }
+  std::memcpy(&header, head, sizeof(header));
   bool diff_endian = false;
 
   switch (header.magic) {
@@ -142,17 +350,21 @@ std::optional<scnr::MachOFat> parse_fat(scnr::StreamData stream) {
   scnr::MachOFat retval;
 
   uint32_t nfat_arch = diff_endian ? scnr::rev_bytes(header.nfat_arch) : header.nfat_arch;
-  if (nfat_arch == 0) {
+  if (nfat_arch == 0 || nfat_arch > kMaxFatArchs) {
+    return {};
+  }
+  // kHeadSize covers the largest accepted arch table
+  if (read_bytes + nfat_arch * sizeof(fat_arch) > head_size) {
     return {};
   }
   for (uint32_t i = 0; i < nfat_arch; ++i) {
+    stream.poll();
     fat_arch arch;
-    if (!stream.readAs(read_bytes, arch)) {
-      return {};
-    }
+    std::memcpy(&arch, head + read_bytes, sizeof(arch));
     auto offset = diff_endian ? scnr::rev_bytes(arch.offset) : arch.offset;
     auto size = diff_endian ? scnr::rev_bytes(arch.size) : arch.size;
-    auto macho = parse_single(stream.advanced(offset));
+    // a slice's load commands stay within the slice
+    auto macho = parse_single(stream.sliced(offset, size), budget);
     if (!macho) {
       return {};
     }
@@ -168,11 +380,16 @@ std::optional<scnr::MachOFat> parse_fat(scnr::StreamData stream) {
 namespace scnr {
 
 std::optional<MachOFile> try_macho(scnr::StreamData stream) {
-  auto fat = parse_fat(stream);
+  ReadBudget budget(kMaxHeaderReads, kMaxHeaderBytes);
+  auto bounded = stream.budgeted(&budget);
+
+  Byte head[kHeadSize];
+  auto nbytes = bounded.readsome(head, 0, sizeof(head));
+  auto fat = parse_fat(bounded, budget, head, nbytes);
   if (fat) {
     return MachOFile{fat.value()};
   }
-  auto single = parse_single(stream);
+  auto single = parse_single(bounded, budget, head, nbytes);
   if (single) {
     return MachOFile{single.value()};
   }
@@ -1,61 +1,219 @@
+#include <scnr/name_table.hpp>
 #include <scnr/parse_pe.hpp>
 
+#include <algorithm>
 #include <bit>
+#include <cstddef>
+#include <cstring>
 #include <optional>
+#include <string_view>
+#include <vector>
 
 #include <scnr/pe/pe.h>
 
-namespace scnr {
+namespace {
 
-std::string_view CpuTypeAsSV(WORD cputype) {
-  std::string_view retval;
-#define SCNR_CASE_MACRO(code)                                                                                          \
-  case code:                                                                                                           \
-    retval = #code;                                                                                                    \
-    break
-
-  switch (cputype) {
-    SCNR_CASE_MACRO(IMAGE_FILE_MACHINE_UNKNOWN);
-    SCNR_CASE_MACRO(IMAGE_FILE_MACHINE_AM33);
-    SCNR_CASE_MACRO(IMAGE_FILE_MACHINE_AMD64);
-    SCNR_CASE_MACRO(IMAGE_FILE_MACHINE_ARM);
-    SCNR_CASE_MACRO(IMAGE_FILE_MACHINE_ARMNT);
-    SCNR_CASE_MACRO(IMAGE_FILE_MACHINE_ARM64);
-    SCNR_CASE_MACRO(IMAGE_FILE_MACHINE_EBC);
-    SCNR_CASE_MACRO(IMAGE_FILE_MACHINE_I386);
-    SCNR_CASE_MACRO(IMAGE_FILE_MACHINE_IA64);
-    SCNR_CASE_MACRO(IMAGE_FILE_MACHINE_M32R);
-    SCNR_CASE_MACRO(IMAGE_FILE_MACHINE_MIPS16);
-    SCNR_CASE_MACRO(IMAGE_FILE_MACHINE_MIPSFPU);
-    SCNR_CASE_MACRO(IMAGE_FILE_MACHINE_MIPSFPU16);
-    SCNR_CASE_MACRO(IMAGE_FILE_MACHINE_POWERPC);
-    SCNR_CASE_MACRO(IMAGE_FILE_MACHINE_POWERPCFP);
-    SCNR_CASE_MACRO(IMAGE_FILE_MACHINE_R4000);
-    SCNR_CASE_MACRO(IMAGE_FILE_MACHINE_SH3);
-    SCNR_CASE_MACRO(IMAGE_FILE_MACHINE_SH3DSP);
-    SCNR_CASE_MACRO(IMAGE_FILE_MACHINE_SH4);
-    SCNR_CASE_MACRO(IMAGE_FILE_MACHINE_SH5);
-    SCNR_CASE_MACRO(IMAGE_FILE_MACHINE_THUMB);
-    SCNR_CASE_MACRO(IMAGE_FILE_MACHINE_WCEMIPSV2);
-    SCNR_CASE_MACRO(IMAGE_FILE_MACHINE_TARGET_HOST);
-    SCNR_CASE_MACRO(IMAGE_FILE_MACHINE_R3000);
-    SCNR_CASE_MACRO(IMAGE_FILE_MACHINE_R10000);
-    SCNR_CASE_MACRO(IMAGE_FILE_MACHINE_ALPHA);
-    SCNR_CASE_MACRO(IMAGE_FILE_MACHINE_SH3E);
-    SCNR_CASE_MACRO(IMAGE_FILE_MACHINE_ALPHA64);
-    SCNR_CASE_MACRO(IMAGE_FILE_MACHINE_TRICORE);
-    SCNR_CASE_MACRO(IMAGE_FILE_MACHINE_CEF);
-    SCNR_CASE_MACRO(IMAGE_FILE_MACHINE_CEE);
-    default:
-      return {};
+// Headers, section table, import directory and DLL names; anything beyond that is a crafted or corrupt file
+constexpr size_t kMaxHeaderReads = 16;
+constexpr size_t kMaxHeaderBytes = 128 * 1024;
+// The Windows loader refuses images with more sections
+constexpr size_t kMaxSections = 96;
+constexpr size_t kMaxImports = 256;
+constexpr size_t kMaxDllName = 256;
+// COFF limit, the upper section numbers are reserved for special symbol values
+constexpr size_t kMaxCoffSections = 0xff00;
+
+// Header shared by the import members of import libraries and bigobj objects: Sig1, Sig2, Version and Machine,
+// Sig1 being IMAGE_FILE_MACHINE_UNKNOWN tells it from a regular object
+constexpr size_t kAnonHeaderSize = 20;
+constexpr size_t kBigObjHeaderSize = 56;
+constexpr WORD kAnonSig2 = 0xffff;
+constexpr size_t kImportSizeOfDataOffset = 12;
+constexpr size_t kBigObjClassIdOffset = 12;
+constexpr size_t kBigObjSectionsOffset = 44;
+constexpr BYTE kBigObjClassId[16] = {0xc7, 0xa1, 0xba, 0xd1, 0xee, 0xba, 0xa9, 0x4b,
+                                     0xaf, 0x20, 0xfa, 0xf6, 0x6a, 0xa4, 0xdc, 0xb8};
+
+// IMAGE_FILE_MACHINE_* values of the file header
+constexpr scnr::NamedValue<WORD> kMachines[] = {
+  SCNR_NAMED(IMAGE_FILE_MACHINE_UNKNOWN),
+  SCNR_NAMED(IMAGE_FILE_MACHINE_AM33),
+  SCNR_NAMED(IMAGE_FILE_MACHINE_AMD64),
+  SCNR_NAMED(IMAGE_FILE_MACHINE_ARM),
+  SCNR_NAMED(IMAGE_FILE_MACHINE_ARMNT),
+  SCNR_NAMED(IMAGE_FILE_MACHINE_ARM64),
+  SCNR_NAMED(IMAGE_FILE_MACHINE_EBC),
+  SCNR_NAMED(IMAGE_FILE_MACHINE_I386),
+  SCNR_NAMED(IMAGE_FILE_MACHINE_IA64),
+  SCNR_NAMED(IMAGE_FILE_MACHINE_M32R),
+  SCNR_NAMED(IMAGE_FILE_MACHINE_MIPS16),
+  SCNR_NAMED(IMAGE_FILE_MACHINE_MIPSFPU),
+  SCNR_NAMED(IMAGE_FILE_MACHINE_MIPSFPU16),
+  SCNR_NAMED(IMAGE_FILE_MACHINE_POWERPC),
+  SCNR_NAMED(IMAGE_FILE_MACHINE_POWERPCFP),
+  SCNR_NAMED(IMAGE_FILE_MACHINE_R4000),
+  SCNR_NAMED(IMAGE_FILE_MACHINE_SH3),
+  SCNR_NAMED(IMAGE_FILE_MACHINE_SH3DSP),
+  SCNR_NAMED(IMAGE_FILE_MACHINE_SH4),
+  SCNR_NAMED(IMAGE_FILE_MACHINE_SH5),
+  SCNR_NAMED(IMAGE_FILE_MACHINE_THUMB),
+  SCNR_NAMED(IMAGE_FILE_MACHINE_WCEMIPSV2),
+  SCNR_NAMED(IMAGE_FILE_MACHINE_TARGET_HOST),
+  SCNR_NAMED(IMAGE_FILE_MACHINE_R3000),
+  SCNR_NAMED(IMAGE_FILE_MACHINE_R10000),
+  SCNR_NAMED(IMAGE_FILE_MACHINE_ALPHA),
+  SCNR_NAMED(IMAGE_FILE_MACHINE_SH3E),
+  SCNR_NAMED(IMAGE_FILE_MACHINE_ALPHA64),
+  SCNR_NAMED(IMAGE_FILE_MACHINE_TRICORE),
+  SCNR_NAMED(IMAGE_FILE_MACHINE_CEF),
+  SCNR_NAMED(IMAGE_FILE_MACHINE_CEE),
+};
+constexpr scnr::NameTable kMachineNames(kMachines, "IMAGE_FILE_MACHINE_");
+
+// IMAGE_SUBSYSTEM_* values of the optional header
+constexpr scnr::NamedValue<WORD> kSubsystems[] = {
+  SCNR_NAMED(IMAGE_SUBSYSTEM_NATIVE),
+  SCNR_NAMED(IMAGE_SUBSYSTEM_WINDOWS_GUI),
+  SCNR_NAMED(IMAGE_SUBSYSTEM_WINDOWS_CUI),
+  SCNR_NAMED(IMAGE_SUBSYSTEM_OS2_CUI),
+  SCNR_NAMED(IMAGE_SUBSYSTEM_POSIX_CUI),
+  SCNR_NAMED(IMAGE_SUBSYSTEM_NATIVE_WINDOWS),
+  SCNR_NAMED(IMAGE_SUBSYSTEM_WINDOWS_CE_GUI),
+  SCNR_NAMED(IMAGE_SUBSYSTEM_EFI_APPLICATION),
+  SCNR_NAMED(IMAGE_SUBSYSTEM_EFI_BOOT_SERVICE_DRIVER),
+  SCNR_NAMED(IMAGE_SUBSYSTEM_EFI_RUNTIME_DRIVER),
+  SCNR_NAMED(IMAGE_SUBSYSTEM_EFI_ROM_IMAGE),
+  SCNR_NAMED(IMAGE_SUBSYSTEM_XBOX),
+  SCNR_NAMED(IMAGE_SUBSYSTEM_WINDOWS_BOOT_APPLICATION),
+};
+constexpr scnr::NameTable kSubsystemNames(kSubsystems, "IMAGE_SUBSYSTEM_");
+
+// Raw data of a section, maps RVAs of data directories to file offsets
+struct Section {
+  DWORD vaddr = 0;
+  DWORD raw_offset = 0;
+  DWORD raw_size = 0;
+};
+
+// Returns the file offset of the RVA and the number of bytes up to the end of its section
+std::optional<std::pair<uint64_t, uint64_t>> rva_to_offset(const std::vector<Section>& sections, DWORD rva) {
+  for (const auto& section : sections) {
+    if (rva >= section.vaddr && rva - section.vaddr < section.raw_size) {
+      const uint64_t delta = rva - section.vaddr;
+      return std::make_pair(section.raw_offset + delta, section.raw_size - delta);
+    }
   }
-#undef SCNR_MACRO_CASE
+  return {};
+}
 
-  retval.remove_prefix(std::strlen("IMAGE_FILE_MACHINE_"));
-  return retval;
+std::vector<Section> read_sections(scnr::StreamData stream, bool diff_endian, uint64_t offset, size_t count) {
+  std::vector<IMAGE_SECTION_HEADER> headers(std::min(count, kMaxSections));
+  if (!stream.read(reinterpret_cast<scnr::Byte*>(headers.data()), offset,
+                   headers.size() * sizeof(IMAGE_SECTION_HEADER))) {
+    return {};
+  }
+  std::vector<Section> sections;
+  for (const auto& header : headers) {
+    sections.push_back({.vaddr = scnr::rev_bytes(header.VirtualAddress, diff_endian),
+                        .raw_offset = scnr::rev_bytes(header.PointerToRawData, diff_endian),
+                        .raw_size = scnr::rev_bytes(header.SizeOfRawData, diff_endian)});
+  }
+  return sections;
+}
+
+// DLL names of the import directory. Its size field is not reliable, the descriptor table ends with
+// an all-zero entry and is only bounded by its section
+std::vector<std::string> read_imports(scnr::StreamData stream, bool diff_endian, const std::vector<Section>& sections,
+                                      DWORD rva) {
+  auto table = rva_to_offset(sections, rva);
+  if (!table) {
+    return {};
+  }
+  std::vector<IMAGE_IMPORT_DESCRIPTOR> descriptors(
+    std::min<uint64_t>(table->second / sizeof(IMAGE_IMPORT_DESCRIPTOR), kMaxImports));
+  descriptors.resize(stream.readsome(reinterpret_cast<scnr::Byte*>(descriptors.data()), table->first,
+                                     descriptors.size() * sizeof(IMAGE_IMPORT_DESCRIPTOR)) /
+                     sizeof(IMAGE_IMPORT_DESCRIPTOR));
+
+  std::vector<uint64_t> offsets;
+  for (const auto& descriptor : descriptors) {
+    auto name = scnr::rev_bytes(descriptor.Name, diff_endian);
+    if (name == 0 && descriptor.FirstThunk == 0) {
+      break;
+    }
+    if (auto offset = rva_to_offset(sections, name)) {
+      offsets.push_back(offset->first);
+    }
+  }
+  auto names = scnr::read_cstrings(stream, offsets, kMaxDllName);
+  names.erase(std::remove(names.begin(), names.end(), std::string()), names.end());
+  return names;
+}
+
+// Section data and the symbol table of an object lie within the file, unlike anything else starting with a machine
+bool coff_within_file(scnr::StreamData stream, bool diff_endian, uint64_t sections_offset, size_t nsections,
+                      DWORD symbols_offset) {
+  const uint64_t file_size = stream.size();
+  if (nsections == 0 || nsections > kMaxCoffSections ||
+      sections_offset + nsections * IMAGE_SIZEOF_SECTION_HEADER > file_size || symbols_offset > file_size) {
+    return false;
+  }
+  std::vector<IMAGE_SECTION_HEADER> headers(std::min(nsections, kMaxSections));
+  if (!stream.read(reinterpret_cast<scnr::Byte*>(headers.data()), sections_offset,
+                   headers.size() * sizeof(IMAGE_SECTION_HEADER))) {
+    return false;
+  }
+  for (const auto& header : headers) {
+    const uint64_t raw_offset = scnr::rev_bytes(header.PointerToRawData, diff_endian);
+    const uint64_t raw_size = scnr::rev_bytes(header.SizeOfRawData, diff_endian);
+    if (raw_size != 0 && (raw_offset > file_size || raw_size > file_size - raw_offset)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename NtHeaders>
+void parse_image(scnr::StreamData stream, bool diff_endian, uint64_t lfanew, const NtHeaders& nt_headers,
+                 scnr::PEFile& pe_file) {
+  const auto& optional_header = nt_headers.OptionalHeader;
+  pe_file.subsystem = kSubsystemNames[scnr::rev_bytes(optional_header.Subsystem, diff_endian)];
+  pe_file.details.dll_characteristics = scnr::rev_bytes(optional_header.DllCharacteristics, diff_endian);
+
+  // directories past NumberOfRvaAndSizes are not part of the header
+  const auto ndirectories = scnr::rev_bytes(optional_header.NumberOfRvaAndSizes, diff_endian);
+  auto directory = [&](size_t index) {
+    IMAGE_DATA_DIRECTORY retval{};
+    if (index < ndirectories) {
+      retval.VirtualAddress = scnr::rev_bytes(optional_header.DataDirectory[index].VirtualAddress, diff_endian);
+      retval.Size = scnr::rev_bytes(optional_header.DataDirectory[index].Size, diff_endian);
+    }
+    return retval;
+  };
+  pe_file.managed = directory(IMAGE_DIRECTORY_ENTRY_COM_DESCRIPTOR).VirtualAddress != 0;
+  // the security directory holds a file offset rather than an RVA, it is not mapped
+  const auto security = directory(IMAGE_DIRECTORY_ENTRY_SECURITY);
+  pe_file.issigned = security.VirtualAddress != 0 && security.Size != 0;
+
+  const auto imports = directory(IMAGE_DIRECTORY_ENTRY_IMPORT);
+  if (imports.VirtualAddress == 0) {
+    return;
+  }
+  const auto sections_offset = lfanew + offsetof(NtHeaders, OptionalHeader) +
+                               scnr::rev_bytes(nt_headers.FileHeader.SizeOfOptionalHeader, diff_endian);
+  const auto sections = read_sections(stream, diff_endian, sections_offset,
+                                      scnr::rev_bytes(nt_headers.FileHeader.NumberOfSections, diff_endian));
+  pe_file.details.imports = read_imports(stream, diff_endian, sections, imports.VirtualAddress);
 }
 
-std::optional<scnr::PEFile> try_pe(scnr::StreamData stream) {
+}  // namespace
+
+namespace scnr {
+
+std::optional<scnr::PEFile> try_pe(scnr::StreamData unbounded) {
+  ReadBudget budget(kMaxHeaderReads, kMaxHeaderBytes);
+  auto stream = unbounded.budgeted(&budget);
+
   scnr::PEFile pe_file;
   pe_file.endian = std::endian::little;
 
@@ -94,17 +252,105 @@ std::optional<scnr::PEFile> try_pe(scnr::StreamData stream) {
   }
   const auto machine =
     scnr::rev_bytes(pe_file.w64 ? nt_headers64.FileHeader.Machine : nt_headers32.FileHeader.Machine, diff_endian);
-  pe_file.cputype = CpuTypeAsSV(machine);
+  pe_file.cputype = kMachineNames[machine];
 
   if (pe_file.w64) {
-    pe_file.managed =
-      nt_headers64.OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_COM_DESCRIPTOR].VirtualAddress != 0;
+    parse_image(stream, diff_endian, lfanew, nt_headers64, pe_file);
   } else {
-    pe_file.managed =
-      nt_headers32.OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_COM_DESCRIPTOR].VirtualAddress != 0;
+    parse_image(stream, diff_endian, lfanew, nt_headers32, pe_file);
   }
 
   return pe_file;
 }
 
+std::optional<CoffFile> try_coff(scnr::StreamData unbounded) {
+  ReadBudget budget(kMaxHeaderReads, kMaxHeaderBytes);
+  auto stream = unbounded.budgeted(&budget);
+  const bool diff_endian = std::endian::native != std::endian::little;
+
+  BYTE header[kBigObjHeaderSize];
+  const size_t nbytes = stream.readsome(header, 0, sizeof(header));
+  if (nbytes < IMAGE_SIZEOF_FILE_HEADER) {
+    return {};
+  }
+  auto word = [&](size_t offset) {
+    WORD value;
+    std::memcpy(&value, header + offset, sizeof(value));
+    return scnr::rev_bytes(value, diff_endian);
+  };
+  auto dword = [&](size_t offset) {
+    DWORD value;
+    std::memcpy(&value, header + offset, sizeof(value));
+    return scnr::rev_bytes(value, diff_endian);
+  };
+
+  CoffFile retval;
+  if (word(0) == IMAGE_FILE_MACHINE_UNKNOWN && word(2) == kAnonSig2) {
+    retval.cputype = kMachineNames[word(6)];
+    const WORD version = word(4);
+    if (version == 0) {
+      // a name and a DLL name follow the header, nothing else
+      retval.format = "import";
+      if (kAnonHeaderSize + uint64_t{dword(kImportSizeOfDataOffset)} > stream.size()) {
+        return {};
+      }
+    } else if (version >= 2 && nbytes == sizeof(header) &&
+               std::memcmp(header + kBigObjClassIdOffset, kBigObjClassId, sizeof(kBigObjClassId)) == 0) {
+      retval.format = "bigobj";
+      if (!coff_within_file(stream, diff_endian, kBigObjHeaderSize, dword(kBigObjSectionsOffset),
+                            dword(kBigObjSectionsOffset + 4))) {
+        return {};
+      }
+    } else {
+      return {};
+    }
+  } else {
+    IMAGE_FILE_HEADER file_header;
+    std::memcpy(&file_header, header, sizeof(file_header));
+    retval.cputype = kMachineNames[scnr::rev_bytes(file_header.Machine, diff_endian)];
+    retval.format = "object";
+    // images have an optional header, and are PE files anyway
+    if (file_header.SizeOfOptionalHeader != 0 ||
+        !coff_within_file(stream, diff_endian, IMAGE_SIZEOF_FILE_HEADER,
+                          scnr::rev_bytes(file_header.NumberOfSections, diff_endian),
+                          scnr::rev_bytes(file_header.PointerToSymbolTable, diff_endian))) {
+      return {};
+    }
+  }
+  // machine values of tools rather than of files
+  if (retval.cputype.empty() || retval.cputype == "UNKNOWN" || retval.cputype == "TARGET_HOST") {
+    return {};
+  }
+  return retval;
+}
+
+std::ostream& operator<<(std::ostream& os, const PEDetails& details) {
+  static constexpr std::pair<WORD, std::string_view> kFlags[] = {
+    {IMAGE_DLLCHARACTERISTICS_HIGH_ENTROPY_VA, "HIGH_ENTROPY_VA"},
+    {IMAGE_DLLCHARACTERISTICS_DYNAMIC_BASE, "DYNAMIC_BASE"},
+    {IMAGE_DLLCHARACTERISTICS_FORCE_INTEGRITY, "FORCE_INTEGRITY"},
+    {IMAGE_DLLCHARACTERISTICS_NX_COMPAT, "NX_COMPAT"},
+    {IMAGE_DLLCHARACTERISTICS_NO_ISOLATION, "NO_ISOLATION"},
+    {IMAGE_DLLCHARACTERISTICS_NO_SEH, "NO_SEH"},
+    {IMAGE_DLLCHARACTERISTICS_NO_BIND, "NO_BIND"},
+    {IMAGE_DLLCHARACTERISTICS_APPCONTAINER, "APPCONTAINER"},
+    {IMAGE_DLLCHARACTERISTICS_WDM_DRIVER, "WDM_DRIVER"},
+    {IMAGE_DLLCHARACTERISTICS_GUARD_CF, "GUARD_CF"},
+    {IMAGE_DLLCHARACTERISTICS_TERMINAL_SERVER_AWARE, "TERMINAL_SERVER_AWARE"},
+  };
+  os << "dll-characteristics = [";
+  const char* sep = "";
+  for (const auto& [flag, name] : kFlags) {
+    if (details.dll_characteristics & flag) {
+      os << sep << name;
+      sep = ", ";
+    }
+  }
+  os << "], imports = [";
+  for (size_t i = 0; i < details.imports.size(); ++i) {
+    os << (i ? ", " : "") << details.imports[i];
+  }
+  return os << "]";
+}
+
 }  // namespace scnr
@@ -0,0 +1,83 @@
+#include <scnr/parse_encoding.hpp>
+#include <scnr/parse_script.hpp>
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace {
+
+constexpr std::string_view kShebang = "#!";
+// BINPRM_BUF_SIZE, the kernel does not look further either
+constexpr size_t kMaxShebangLine = 256;
+constexpr std::string_view kBlanks = " \t";
+
+std::string_view next_token(std::string_view& line) {
+  const size_t start = std::min(line.find_first_not_of(kBlanks), line.size());
+  const size_t end = std::min(line.find_first_of(kBlanks, start), line.size());
+  auto retval = line.substr(start, end - start);
+  line.remove_prefix(end);
+  return retval;
+}
+
+std::string_view basename(std::string_view path) {
+  const size_t slash = path.rfind('/');
+  return slash == std::string_view::npos ? path : path.substr(slash + 1);
+}
+
+// The command env runs: options such as -S and -i and variable assignments come first
+std::string_view env_command(std::string_view arguments) {
+  while (true) {
+    auto token = next_token(arguments);
+    if (token.empty() || (token[0] != '-' && token.find('=') == std::string_view::npos)) {
+      return basename(token);
+    }
+  }
+}
+
+}  // namespace
+
+namespace scnr {
+
+std::optional<ScriptFile> try_script(scnr::StreamData stream, bool check_encoding) {
+  char buf[kMaxShebangLine];
+  const size_t nbytes = stream.readsome(reinterpret_cast<Byte*>(buf), 0, sizeof(buf));
+  std::string_view line(buf, nbytes);
+  if (line.substr(0, kShebang.size()) != kShebang) {
+    return {};
+  }
+  line = line.substr(kShebang.size(), line.find('\n') - kShebang.size());
+  if (!line.empty() && line.back() == '\r') {
+    line.remove_suffix(1);
+  }
+  // a binary file that happens to start with "#!" has no line of text there
+  for (char c : line) {
+    if (static_cast<unsigned char>(c) < ' ' && c != '\t') {
+      return {};
+    }
+  }
+
+  ScriptFile retval;
+  retval.details.path = next_token(line);
+  if (retval.details.path.empty()) {
+    return {};
+  }
+  const size_t arguments = line.find_first_not_of(kBlanks);
+  if (arguments != std::string_view::npos) {
+    line.remove_prefix(arguments);
+    retval.details.arguments = line.substr(0, line.find_last_not_of(kBlanks) + 1);
+  }
+  const auto interpreter = basename(retval.details.path);
+  retval.interpreter = interpreter == "env" ? env_command(retval.details.arguments) : interpreter;
+  if (retval.interpreter.empty()) {
+    retval.interpreter = interpreter;
+  }
+
+  if (check_encoding) {
+    auto txt = try_txt(stream);
+    retval.encoding = txt ? txt.value().encoding : "binary";
+  }
+  return retval;
+}
+
+}  // namespace scnr
@@ -1,26 +1,117 @@
 #include <scnr/parse_encoding.hpp>
 #include <scnr/parse_xml.hpp>
 
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace {
+
+constexpr std::string_view kXmlMagic = "<?xml";
+// the declaration comes first and is short, longer ones are cut
+constexpr size_t kMaxDeclaration = 512;
+
+// Where the declaration starts and how wide its characters are
+struct Layout {
+  size_t start = 0;
+  size_t unit = 1;
+  bool bigendian = false;
+};
+
+// ASCII character of the index-th code unit, -1 past the end or for other characters
+int char_at(const scnr::Byte* buf, size_t size, const Layout& layout, size_t index) {
+  const size_t pos = layout.start + index * layout.unit;
+  if (pos + layout.unit > size) {
+    return -1;
+  }
+  if (layout.unit == 1) {
+    return buf[pos] < 0x80 ? buf[pos] : -1;
+  }
+  const scnr::Byte hi = buf[pos + (layout.bigendian ? 0 : 1)];
+  const scnr::Byte lo = buf[pos + (layout.bigendian ? 1 : 0)];
+  return hi == 0 && lo < 0x80 ? lo : -1;
+}
+
+bool starts_with_magic(const scnr::Byte* buf, size_t size, const Layout& layout) {
+  for (size_t i = 0; i < kXmlMagic.size(); ++i) {
+    if (char_at(buf, size, layout, i) != kXmlMagic[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// A byte order mark decides the layout, "<\0?\0" and "\0<\0?" are UTF-16 without one
+std::optional<Layout> find_layout(const scnr::Byte* buf, size_t size) {
+  std::optional<Layout> bom;
+  if (size >= 3 && buf[0] == 0xef && buf[1] == 0xbb && buf[2] == 0xbf) {
+    bom = Layout{.start = 3};
+  } else if (size >= 2 && buf[0] == 0xff && buf[1] == 0xfe) {
+    bom = Layout{.start = 2, .unit = 2};
+  } else if (size >= 2 && buf[0] == 0xfe && buf[1] == 0xff) {
+    bom = Layout{.start = 2, .unit = 2, .bigendian = true};
+  }
+  if (bom) {
+    return starts_with_magic(buf, size, bom.value()) ? bom : std::nullopt;
+  }
+  for (const Layout layout : {Layout{}, Layout{.unit = 2}, Layout{.unit = 2, .bigendian = true}}) {
+    if (starts_with_magic(buf, size, layout)) {
+      return layout;
+    }
+  }
+  return {};
+}
+
+// Value of the encoding pseudo-attribute, e.g. <?xml version="1.0" encoding="ISO-8859-1"?>
+std::string declared_encoding(const scnr::Byte* buf, size_t size, const Layout& layout) {
+  std::string declaration;
+  for (size_t i = kXmlMagic.size(); declaration.find("?>") == std::string::npos; ++i) {
+    const int c = char_at(buf, size, layout, i);
+    if (c < 0) {
+      break;
+    }
+    declaration.push_back(static_cast<char>(c));
+  }
+  constexpr std::string_view kEncoding = "encoding";
+  size_t pos = declaration.find(kEncoding);
+  if (pos == std::string::npos || pos == 0 || declaration[pos - 1] > ' ') {
+    return {};
+  }
+  pos = declaration.find_first_not_of(" \t\r\n", pos + kEncoding.size());
+  if (pos == std::string::npos || declaration[pos] != '=') {
+    return {};
+  }
+  pos = declaration.find_first_not_of(" \t\r\n", pos + 1);
+  if (pos == std::string::npos || (declaration[pos] != '"' && declaration[pos] != '\'')) {
+    return {};
+  }
+  const size_t end = declaration.find(declaration[pos], pos + 1);
+  if (end == std::string::npos) {
+    return {};
+  }
+  return declaration.substr(pos + 1, end - pos - 1);
+}
+
+}  // namespace
+
 namespace scnr {
 
-std::optional<XmlFile> try_xml(scnr::StreamData stream) {
+std::optional<XmlFile> try_xml(scnr::StreamData stream, size_t max_validated) {
   // poor man's detector, but 'file' utility works in the same way
-  static constexpr std::string_view magic = "<?xml";
-  Byte buf[magic.size()];
-  if (!stream.read(buf, 0, magic.size())) {
+  Byte buf[kMaxDeclaration];
+  const size_t nbytes = stream.readsome(buf, 0, sizeof(buf));
+  auto layout = find_layout(buf, nbytes);
+  if (!layout) {
     return {};
   }
-  for (size_t i = 0; i < magic.size(); ++i) {
-    if (magic[i] != buf[i]) {
-      return {};
-    }
-  }
 
-  auto txt = scnr::try_txt(stream.advanced(magic.size()));
+  auto txt = scnr::try_txt(stream, max_validated);
   if (!txt) {
     return {};
   }
-  return XmlFile{.encoding = txt.value().encoding};
+  XmlFile retval{.encoding = txt.value().encoding};
+  retval.details.declared = declared_encoding(buf, nbytes, layout.value());
+  return retval;
 }
 
-}  // namespace scnr
\ No newline at end of file
+}  // namespace scnr
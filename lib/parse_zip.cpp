@@ -0,0 +1,264 @@
+#include <scnr/inflate.hpp>
+#include <scnr/parse_archive.hpp>
+#include <scnr/util.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+constexpr std::string_view kLocalMagic = "PK\3\4";
+// an empty archive is nothing but the end of central directory record
+constexpr std::string_view kEmptyMagic = "PK\5\6";
+
+constexpr uint32_t kEndSignature = 0x06054b50;
+constexpr size_t kEndSize = 22;
+// the archive comment follows the end record, it is at most 64 KiB
+constexpr size_t kMaxComment = 0xffff;
+constexpr uint32_t kZip64LocatorSignature = 0x07064b50;
+constexpr size_t kZip64LocatorSize = 20;
+constexpr uint32_t kZip64EndSignature = 0x06064b50;
+constexpr size_t kZip64EndSize = 56;
+constexpr uint32_t kCentralSignature = 0x02014b50;
+constexpr size_t kCentralSize = 46;
+constexpr uint32_t kLocalSignature = 0x04034b50;
+constexpr size_t kLocalSize = 30;
+constexpr uint16_t kZip64ExtraId = 0x0001;
+
+constexpr uint16_t kFlagEncrypted = 0x0001;
+constexpr uint16_t kMethodStored = 0;
+constexpr uint16_t kMethodDeflated = 8;
+
+// Directories of real archives are a few MiB at most, entries beyond are not looked at
+constexpr size_t kMaxCentralDirectory = 8 * 1024 * 1024;
+// Deflated members are classified from a prefix, header detectors need far less
+constexpr size_t kMaxInflatedProbe = 16 * 1024;
+
+template <typename T>
+T get_le(const scnr::Byte* p) {
+  T value;
+  std::memcpy(&value, p, sizeof(value));
+  return scnr::LEToHost(value);
+}
+
+struct CentralDirectory {
+  uint64_t offset = 0;
+  uint64_t size = 0;
+  uint64_t entries = 0;
+  // archives with something in front, e.g. self-extracting ones, store offsets relative to the archive start
+  uint64_t delta = 0;
+};
+
+// The 64-bit record is located by a locator right in front of the end record
+void read_zip64_end(scnr::StreamData stream, uint64_t end_pos, CentralDirectory& cd) {
+  scnr::Byte locator[kZip64LocatorSize];
+  if (end_pos < sizeof(locator) || !stream.read(locator, end_pos - sizeof(locator), sizeof(locator)) ||
+      get_le<uint32_t>(locator) != kZip64LocatorSignature) {
+    return;
+  }
+  scnr::Byte record[kZip64EndSize];
+  const uint64_t record_pos = get_le<uint64_t>(locator + 8);
+  if (!stream.read(record, record_pos, sizeof(record)) || get_le<uint32_t>(record) != kZip64EndSignature) {
+    return;
+  }
+  cd.entries = get_le<uint64_t>(record + 32);
+  cd.size = get_le<uint64_t>(record + 40);
+  cd.offset = get_le<uint64_t>(record + 48);
+}
+
+std::optional<CentralDirectory> find_central_directory(scnr::StreamData stream) {
+  const size_t file_size = stream.size();
+  if (file_size < kEndSize) {
+    return {};
+  }
+  // the record is searched backwards, a comment may contain the signature too
+  const size_t tail_size = std::min(file_size, kEndSize + kMaxComment);
+  const size_t tail_pos = file_size - tail_size;
+  std::vector<scnr::Byte> tail(tail_size);
+  if (!stream.read(tail.data(), tail_pos, tail.size())) {
+    return {};
+  }
+  for (size_t i = tail_size - kEndSize + 1; i-- > 0;) {
+    const scnr::Byte* end = tail.data() + i;
+    if (get_le<uint32_t>(end) != kEndSignature || i + kEndSize + get_le<uint16_t>(end + 20) > tail_size) {
+      continue;
+    }
+    CentralDirectory cd{.offset = get_le<uint32_t>(end + 16),
+                        .size = get_le<uint32_t>(end + 12),
+                        .entries = get_le<uint16_t>(end + 10)};
+    const uint64_t end_pos = tail_pos + i;
+    if (cd.offset == 0xffffffff || cd.size == 0xffffffff || cd.entries == 0xffff) {
+      read_zip64_end(stream, end_pos, cd);
+    }
+    if (cd.size > end_pos || cd.offset > end_pos - cd.size) {
+      return {};
+    }
+    cd.delta = end_pos - cd.size - cd.offset;
+    return cd;
+  }
+  return {};
+}
+
+// Sizes and the local header offset are 0xffffffff in the entry when they are in the ZIP64 extra field
+void apply_zip64_extra(std::string_view extra, uint64_t& uncompressed, uint64_t& compressed, uint64_t& local) {
+  while (extra.size() >= 4) {
+    const auto* p = reinterpret_cast<const scnr::Byte*>(extra.data());
+    const uint16_t id = get_le<uint16_t>(p);
+    const uint16_t size = get_le<uint16_t>(p + 2);
+    if (size > extra.size() - 4) {
+      return;
+    }
+    if (id == kZip64ExtraId) {
+      size_t pos = 4;
+      for (uint64_t* field : {&uncompressed, &compressed, &local}) {
+        if (*field == 0xffffffff && pos + 8 <= 4u + size) {
+          *field = get_le<uint64_t>(p + pos);
+          pos += 8;
+        }
+      }
+      return;
+    }
+    extra.remove_prefix(4 + size);
+  }
+}
+
+// Zip based package formats are told apart by well-known entries
+struct PackageHints {
+  bool manifest = false;
+  bool android_manifest = false;
+  bool dex = false;
+  bool wheel = false;
+  bool nuspec = false;
+
+  void Add(std::string_view name) {
+    auto ends_with = [&](std::string_view suffix) {
+      return name.size() >= suffix.size() && name.substr(name.size() - suffix.size()) == suffix;
+    };
+    manifest |= name == "META-INF/MANIFEST.MF";
+    android_manifest |= name == "AndroidManifest.xml";
+    dex |= name == "classes.dex";
+    wheel |= name.find('/') == name.rfind('/') && ends_with(".dist-info/WHEEL");
+    nuspec |= name.find('/') == std::string_view::npos && ends_with(".nuspec");
+  }
+
+  std::string_view Format() const {
+    if (android_manifest && dex) {
+      return "apk";
+    }
+    if (wheel) {
+      return "wheel";
+    }
+    if (nuspec) {
+      return "nupkg";
+    }
+    if (manifest) {
+      return "jar";
+    }
+    return "zip";
+  }
+};
+
+// Hands the member to the visitor: stored data as a slice of the archive, deflated data as a prefix inflated
+// into memory. Returns what the visitor returned, nothing for members of other methods or without local header
+std::optional<bool> visit_member(scnr::StreamData stream, const scnr::MemberVisitor& visit, uint16_t method,
+                                 uint64_t local, uint64_t compressed) {
+  scnr::Byte header[kLocalSize];
+  if (!stream.read(header, local, sizeof(header)) || get_le<uint32_t>(header) != kLocalSignature) {
+    return {};
+  }
+  // the local extra field may differ from the central one
+  const uint64_t data = local + sizeof(header) + get_le<uint16_t>(header + 26) + get_le<uint16_t>(header + 28);
+  if (method == kMethodStored) {
+    return visit(stream.sliced(data, compressed));
+  }
+  if (method != kMethodDeflated) {
+    return {};
+  }
+  scnr::Inflater inflater(stream.sliced(data, compressed));
+  std::string prefix(kMaxInflatedProbe, '\0');
+  prefix.resize(inflater.Read(reinterpret_cast<scnr::Byte*>(prefix.data()), prefix.size()));
+  std::istringstream ss(std::move(prefix));
+  return visit(stream.redirected(&ss));
+}
+
+}  // namespace
+
+namespace scnr {
+
+std::optional<ArchiveFile> try_zip(scnr::StreamData stream, const MemberVisitor& visit) {
+  char magic[kLocalMagic.size()];
+  if (!stream.read(magic, 0, sizeof(magic))) {
+    return {};
+  }
+  const std::string_view sv(magic, sizeof(magic));
+  if (sv != kLocalMagic && sv != kEmptyMagic) {
+    return {};
+  }
+  auto cd = find_central_directory(stream);
+  if (!cd) {
+    return {};
+  }
+
+  ArchiveFile retval{.format = "zip"};
+  const size_t cd_size = std::min<uint64_t>(cd->size, kMaxCentralDirectory);
+  retval.details.truncated = cd_size < cd->size;
+  std::vector<Byte> directory(cd_size);
+  if (!stream.read(directory.data(), cd->offset + cd->delta, directory.size())) {
+    return retval;
+  }
+
+  PackageHints hints;
+  bool visiting = static_cast<bool>(visit);
+  size_t pos = 0;
+  for (uint64_t i = 0; i < cd->entries && pos + kCentralSize <= directory.size(); ++i) {
+    const Byte* entry = directory.data() + pos;
+    if (get_le<uint32_t>(entry) != kCentralSignature) {
+      break;
+    }
+    const uint16_t name_length = get_le<uint16_t>(entry + 28);
+    const uint16_t extra_length = get_le<uint16_t>(entry + 30);
+    const uint16_t comment_length = get_le<uint16_t>(entry + 32);
+    const size_t next = pos + kCentralSize + name_length + extra_length + comment_length;
+    if (next > directory.size()) {
+      break;
+    }
+    const auto* chars = reinterpret_cast<const char*>(entry);
+    const std::string_view name(chars + kCentralSize, name_length);
+    hints.Add(name);
+
+    const uint16_t flags = get_le<uint16_t>(entry + 8);
+    if (visiting && !name.empty() && name.back() != '/' && !(flags & kFlagEncrypted)) {
+      stream.poll();
+      uint64_t uncompressed = get_le<uint32_t>(entry + 24);
+      uint64_t compressed = get_le<uint32_t>(entry + 20);
+      uint64_t local = get_le<uint32_t>(entry + 42);
+      apply_zip64_extra(std::string_view(chars + kCentralSize + name_length, extra_length), uncompressed,
+                        compressed, local);
+      auto visited = visit_member(stream, visit, get_le<uint16_t>(entry + 10), local + cd->delta, compressed);
+      if (visited == true) {
+        retval.details.members += 1;
+      } else if (visited == false) {
+        retval.details.truncated = true;
+        visiting = false;
+      }
+    }
+    pos = next;
+  }
+  retval.format = hints.Format();
+  return retval;
+}
+
+std::optional<std::uint64_t> zip_offset(scnr::StreamData stream) {
+  if (auto cd = find_central_directory(stream)) {
+    return cd->delta;
+  }
+  return {};
+}
+
+}  // namespace scnr
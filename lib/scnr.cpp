@@ -1,3 +1,4 @@
+#include <scnr/parse_archive.hpp>
 #include <scnr/parse_elf.hpp>
 #include <scnr/parse_encoding.hpp>
 #include <scnr/parse_mach-o.hpp>
@@ -5,6 +6,7 @@
 #include <scnr/scnr.hpp>
 #include <scnr/thread_pool.hpp>
 #include <scnr/util.hpp>
+#include <scnr/walk.hpp>
 
 #include <algorithm>
 #include <bit>
@@ -18,46 +20,265 @@
 #include <string_view>
 #include <unordered_map>
 #include <variant>
+#include <vector>
 
 namespace {
 
-void process_file_impl(const std::filesystem::path& path, scnr::FileInfoCollector& collector) {
-  auto file = scnr::read_file(path);
-  auto fileinfo = scnr::detect_content(file);
-  collector.Add(std::move(fileinfo));
+// Directories with fewer files are not split between workers
+constexpr size_t kMinFilesPerChunk = 32;
+
+// Smaller files are cheaper to detect than to remember
+constexpr size_t kMinDedupSize = 4 * 1024;
+
+scnr::FileInfo detect_bounded(scnr::StreamData stream, scnr::FileInfoCollector& collector,
+                              const scnr::ScanOptions& options) {
+  try {
+    return scnr::detect_content(stream, options.containers, [&collector](const scnr::MemberInfo& member) {
+      collector.AddMember(member);
+    });
+  } catch (const scnr::TimedOut&) {
+    return scnr::TimedOutFile{};
+  }
 }
 
-void process_impl(const std::filesystem::path& path, scnr::FileInfoCollector& collector) {
-  auto thread_pool = scnr::ThreadPool::Current();
+std::optional<scnr::Clock::time_point> file_deadline(const scnr::ScanOptions& options) {
+  if (options.file_timeout) {
+    return scnr::Clock::now() + options.file_timeout.value();
+  }
+  return {};
+}
+
+// Second is false if the result was taken from an earlier file with the same content
+std::pair<scnr::FileInfo, bool> detect_file(const std::filesystem::path& path, scnr::FileInfoCollector& collector,
+                                            const scnr::ScanOptions& options) {
+  scnr::CancelToken token(options.ctx, file_deadline(options));
+
+  // the walk has already classified the path, File does not need to stat it again
+  scnr::File file(path, /*verify_regular=*/false);
+  auto stream = scnr::StreamData(file).cancellable(&token);
+  if (options.dedup_content) {
+    if (auto fp = scnr::fingerprint(stream); fp.size >= kMinDedupSize) {
+      return collector.DetectContent(fp, [&] {
+        return detect_bounded(stream, collector, options);
+      });
+    }
+  }
+  return {detect_bounded(stream, collector, options), true};
+}
+
+// The search reads the whole file, it gets a deadline of its own; a timed out search reports nothing
+std::vector<scnr::EmbeddedFile> find_embedded_file(const std::filesystem::path& path,
+                                                   scnr::FileInfoCollector& collector,
+                                                   const scnr::ScanOptions& options) {
+  scnr::CancelToken token(options.ctx, file_deadline(options));
+  scnr::File file(path, /*verify_regular=*/false);
+  try {
+    return scnr::find_embedded(scnr::StreamData(file).cancellable(&token), options.containers,
+                               [&collector](const scnr::MemberInfo& member) {
+                                 collector.AddMember(member);
+                               });
+  } catch (const scnr::TimedOut&) {
+    return {};
+  }
+}
 
-  if (!std::filesystem::exists(path)) {
-    std::stringstream ss;
-    ss << "'" << path.string() << "' does not exist!\n";
-    std::cout << ss.str();
-    return;
-  }
-
-  if (std::filesystem::is_directory(path)) {
-    std::filesystem::directory_iterator dir_iter(path);
-    for (auto const& dir_entry : dir_iter) {
-      auto path = dir_entry.path();
-      if (thread_pool) {  // concurrent
-        thread_pool->Submit([path, &collector] {
-          process_impl(path, collector);
-        });
-      } else {  // straight recursive
-        process_impl(path, collector);
+void check_stop(const scnr::ScanOptions& options) {
+  if (options.ctx && options.ctx->StopRequested()) {
+    throw scnr::Cancelled();
+  }
+}
+
+// Second is false if the result was reused from another hard link or a copy with the same content
+std::pair<scnr::FileInfo, bool> process_file_impl(const std::filesystem::path& path,
+                                                  scnr::FileInfoCollector& collector,
+                                                  const scnr::ScanOptions& options) {
+  if (options.hardlinks != scnr::HardLinks::kOff) {
+    // inodes with a single link can not show up again, no need to remember them
+    if (auto status = scnr::stat_file(path); status && status->nlink > 1) {
+      bool detected = false;
+      auto [fileinfo, first] = collector.DetectInode(status->id, [&] {
+        auto [info, fresh] = detect_file(path, collector, options);
+        detected = fresh;
+        return info;
+      });
+      if (first || options.hardlinks == scnr::HardLinks::kCountLinks) {
+        collector.Add(fileinfo);
       }
+      return {fileinfo, first && detected};
+    }
+  }
+  auto retval = detect_file(path, collector, options);
+  collector.Add(retval.first);
+  return retval;
+}
+
+void process_file(const std::filesystem::path& path, scnr::FileInfoCollector& collector,
+                  const scnr::ScanOptions& options) {
+  auto [fileinfo, detected] = process_file_impl(path, collector, options);
+  if (options.on_file) {
+    options.on_file(path, fileinfo);
+  }
+  // hard links and copies were searched with the file they reuse the result of
+  if (options.on_embedded && detected) {
+    options.on_embedded(path, find_embedded_file(path, collector, options));
+  }
+}
+
+void process_files(const std::vector<scnr::DirEntry>& files, scnr::FileInfoCollector& collector,
+                   const scnr::ScanOptions& options) {
+  for (const auto& entry : files) {
+    check_stop(options);
+    // one broken file must not cost the rest of the chunk
+    try {
+      process_file(entry.path, collector, options);
+    } catch (const scnr::Cancelled&) {
+      throw;
+    } catch (const std::exception&) {
+    }
+  }
+}
+
+// Classifies the entry by d_type, lstat only if readdir did not tell, and resolves symlinks according
+// to the policy. Returns kRegular, kDirectory or a type the walk skips
+scnr::EntryType resolve_entry(scnr::DirEntry& entry, scnr::Follow follow) {
+  if (entry.type == scnr::EntryType::kUnknown) {
+    entry.type = scnr::entry_type(entry.path, /*follow_symlinks=*/false);
+  }
+  if (entry.type != scnr::EntryType::kSymlink) {
+    return entry.type;
+  }
+  if (follow == scnr::Follow::kNever) {
+    return scnr::EntryType::kOther;
+  }
+  auto target = scnr::entry_type(entry.path, /*follow_symlinks=*/true);
+  if (target == scnr::EntryType::kDirectory && follow != scnr::Follow::kAll) {
+    return scnr::EntryType::kOther;
+  }
+  return target;
+}
+
+void process_directory(const std::filesystem::path& path, scnr::FileInfoCollector& collector,
+                       const scnr::ScanOptions& options);
+
+void process_entry(scnr::DirEntry entry, scnr::FileInfoCollector& collector, const scnr::ScanOptions& options) {
+  switch (resolve_entry(entry, options.follow)) {
+    case scnr::EntryType::kRegular:
+      process_files({entry}, collector, options);
+      break;
+    case scnr::EntryType::kDirectory:
+      process_directory(entry.path, collector, options);
+      break;
+    default:
+      // devices, fifos, sockets, broken or not followed symlinks
+      break;
+  }
+}
+
+void process_directory_breadth_first(const std::filesystem::path& path, scnr::FileInfoCollector& collector,
+                                     const scnr::ScanOptions& options) {
+  auto thread_pool = scnr::ThreadPool::Current();
+
+  for (auto& entry : scnr::list_directory(path)) {
+    if (thread_pool) {  // concurrent
+      thread_pool->Submit([entry = std::move(entry), &collector, &options] {
+        process_entry(entry, collector, options);
+      });
+    } else {  // straight recursive
+      process_entry(std::move(entry), collector, options);
     }
-    return;
   }
+}
+
+void process_directory_depth_first(const std::filesystem::path& path, scnr::FileInfoCollector& collector,
+                                   const scnr::ScanOptions& options) {
+  auto thread_pool = scnr::ThreadPool::Current();
 
-  if (std::filesystem::is_regular_file(path)) {
-    process_file_impl(path, collector);
-    return;
+  std::vector<scnr::DirEntry> files;
+  std::vector<std::filesystem::path> subdirs;
+  for (auto& entry : scnr::list_directory(path)) {
+    switch (resolve_entry(entry, options.follow)) {
+      case scnr::EntryType::kRegular:
+        files.push_back(std::move(entry));
+        break;
+      case scnr::EntryType::kDirectory:
+        subdirs.push_back(std::move(entry.path));
+        break;
+      default:
+        break;
+    }
   }
 
-  // symlinks?..
+  scnr::order_files(files, options.order);
+
+  if (thread_pool) {
+    // everything except the first chunk and the last subtree goes to the queue, so other workers steal
+    // large contiguous pieces of work while this one keeps walking depth-first
+    const size_t workers = std::max<size_t>(thread_pool->Workers(), 1);
+    const size_t chunk = std::max(kMinFilesPerChunk, (files.size() + workers - 1) / workers);
+    for (size_t i = 0; i + 1 < subdirs.size(); ++i) {
+      thread_pool->Submit([subdir = std::move(subdirs[i]), &collector, &options] {
+        process_directory(subdir, collector, options);
+      });
+    }
+    for (size_t from = chunk; from < files.size(); from += chunk) {
+      auto to = std::min(from + chunk, files.size());
+      thread_pool->Submit([part = std::vector<scnr::DirEntry>(std::make_move_iterator(files.begin() + from),
+                                                              std::make_move_iterator(files.begin() + to)),
+                           &collector, &options] {
+        process_files(part, collector, options);
+      });
+    }
+    files.resize(std::min(chunk, files.size()));
+    if (!subdirs.empty()) {
+      subdirs.erase(subdirs.begin(), subdirs.end() - 1);
+    }
+  }
+
+  process_files(files, collector, options);
+  for (const auto& subdir : subdirs) {
+    process_directory(subdir, collector, options);
+  }
+}
+
+void process_directory(const std::filesystem::path& path, scnr::FileInfoCollector& collector,
+                       const scnr::ScanOptions& options) {
+  check_stop(options);
+  // followed directory symlinks may point to an ancestor, remembering every walked directory
+  // also keeps symlinks to siblings and bind mounts from being walked twice
+  if (options.follow == scnr::Follow::kAll || options.hardlinks != scnr::HardLinks::kOff) {
+    if (auto status = scnr::stat_file(path); status && !collector.VisitDirectory(status->id)) {
+      return;
+    }
+  }
+  switch (options.traversal) {
+    case scnr::Traversal::kBreadthFirst:
+      process_directory_breadth_first(path, collector, options);
+      break;
+    case scnr::Traversal::kDepthFirst:
+      process_directory_depth_first(path, collector, options);
+      break;
+  }
+}
+
+// Paths given explicitly are always followed
+void process_impl(const std::filesystem::path& path, scnr::FileInfoCollector& collector,
+                  const scnr::ScanOptions& options) {
+  switch (scnr::entry_type(path, /*follow_symlinks=*/true)) {
+    case scnr::EntryType::kUnknown: {
+      std::stringstream ss;
+      ss << "'" << path.string() << "' does not exist!\n";
+      std::cout << ss.str();
+      break;
+    }
+    case scnr::EntryType::kDirectory:
+      process_directory(path, collector, options);
+      break;
+    case scnr::EntryType::kRegular:
+      process_file(path, collector, options);
+      break;
+    default:
+      break;
+  }
 }
 
 }  // namespace
@@ -65,13 +286,75 @@ void process_impl(const std::filesystem::path& path, scnr::FileInfoCollector& co
 namespace scnr {
 
 FileInfo detect_content(scnr::StreamData stream) {
+  return detect_content(stream, ContainerOptions{.max_depth = 0}, {});
+}
+
+FileInfo detect_magic(scnr::StreamData stream, const ContainerOptions& options, const MemberSink& sink,
+                      size_t depth) {
+  // members are reported once the container format is known
+  std::vector<FileInfo> members;
+  MemberVisitor visit;
+  if (sink && depth < options.max_depth) {
+    visit = [&](StreamData member) {
+      if (members.size() >= options.max_members) {
+        return false;
+      }
+      members.push_back(detect_content(member, options, sink, depth + 1));
+      return true;
+    };
+  }
+
+  // content of nested compressed files is not decompressed, a file may decompress into itself
+  std::shared_ptr<const CompressedContent> content;
+  ContentVisitor decompress;
+  if (options.max_decompressed > 0) {
+    decompress = [&](StreamData data) {
+      ContainerOptions inner = options;
+      inner.max_decompressed = 0;
+      content = std::make_shared<CompressedContent>(CompressedContent{detect_content(data, inner, sink, depth)});
+    };
+  }
+
   FileInfo fileinfo;
-  if (auto elf = try_elf(stream)) {
+  if (auto custom = options.rules ? try_custom(stream, *options.rules) : std::nullopt) {
+    fileinfo = std::move(custom.value());
+  } else if (auto elf = try_elf(stream)) {
     fileinfo = std::move(elf.value());
   } else if (auto macho = try_macho(stream)) {
     fileinfo = std::move(macho.value());
   } else if (auto pe = try_pe(stream)) {
     fileinfo = std::move(pe.value());
+  } else if (auto wasm = try_wasm(stream)) {
+    fileinfo = std::move(wasm.value());
+  } else if (auto java = try_java_class(stream)) {
+    fileinfo = std::move(java.value());
+  } else if (auto dex = try_dex(stream)) {
+    fileinfo = std::move(dex.value());
+  } else if (auto bitcode = try_bitcode(stream)) {
+    fileinfo = std::move(bitcode.value());
+  } else if (auto coff = try_coff(stream)) {
+    fileinfo = std::move(coff.value());
+  } else if (auto compressed = try_compressed(stream, options.max_decompressed, decompress)) {
+    fileinfo = CompressedFile{.format = compressed.value(), .content = std::move(content)};
+  } else if (auto archive = try_archive(stream, visit)) {
+    for (auto& member : members) {
+      sink(MemberInfo{.container = archive->format, .info = std::move(member)});
+    }
+    fileinfo = std::move(archive.value());
+  }
+  return fileinfo;
+}
+
+FileInfo detect_content(scnr::StreamData stream, const ContainerOptions& options, const MemberSink& sink,
+                        size_t depth) {
+  FileInfo fileinfo = detect_magic(stream, options, sink, depth);
+  if (!std::holds_alternative<std::monostate>(fileinfo)) {
+    return fileinfo;
+  }
+  if (auto data = try_data(stream, options.data)) {
+    fileinfo = std::move(data.value());
+  } else if (auto script = try_script(stream, options.script_encoding)) {
+    fileinfo = std::move(script.value());
   } else if (auto xml = try_xml(stream)) {
     fileinfo = std::move(xml.value());
   } else if (auto txt = try_txt(stream)) {
@@ -80,13 +363,94 @@ FileInfo detect_content(scnr::StreamData stream) {
   return fileinfo;
 }
 
-void process(const std::filesystem::path& path, FileInfoCollector& collector) {
-  process_impl(path, collector);
+FileInfo summary_key(const FileInfo& info) {
+  FileInfo retval = info;
+  std::visit(
+    [](auto& arg) {
+      using T = std::decay_t<decltype(arg)>;
+      if constexpr (requires { arg.details; }) {
+        arg.details = {};
+      } else if constexpr (std::is_same_v<T, MachOFile>) {
+        if (auto single = std::get_if<MachOSingle>(&arg.value)) {
+          single->details = {};
+        } else {
+          for (auto& slice : std::get<MachOFat>(arg.value).files) {
+            slice.details = {};
+          }
+        }
+      } else if constexpr (std::is_same_v<T, CompressedFile>) {
+        if (arg.content) {
+          arg.content = std::make_shared<const CompressedContent>(CompressedContent{summary_key(arg.content->info)});
+        }
+      }
+    },
+    retval);
+  return retval;
+}
+
+void process(const std::filesystem::path& path, FileInfoCollector& collector, const ScanOptions& options) {
+  process_impl(path, collector, options);
 }
 
 void FileInfoCollector::Add(const FileInfo& fileinfo) {
+  auto key = summary_key(fileinfo);
   std::lock_guard lock(mutex);
-  mp[fileinfo] += 1;
+  mp[key] += 1;
+}
+
+void FileInfoCollector::AddMember(const MemberInfo& member) {
+  MemberInfo key{.container = member.container, .info = summary_key(member.info)};
+  std::lock_guard lock(mutex);
+  members[key] += 1;
+}
+
+std::vector<std::pair<int, MemberInfo>> FileInfoCollector::SummarizeMembers() const {
+  std::unique_lock lock(mutex);
+  std::vector<std::pair<int, MemberInfo>> retval;
+  for (const auto& [k, v] : members) {
+    retval.push_back({v, k});
+  }
+  lock.unlock();
+  std::sort(retval.begin(), retval.end(), [](const auto& lhs, const auto& rhs) {
+    if (lhs.first == rhs.first) {
+      return lhs.second.info.index() < rhs.second.info.index();
+    }
+    return lhs.first > rhs.first;
+  });
+  return retval;
+}
+
+ScanStats FileInfoCollector::Stats() const {
+  return ScanStats{.hardlinks = hardlinks.load(),
+                   .directories = skipped_directories.load(),
+                   .duplicates = duplicates.load(),
+                   .duplicate_bytes = duplicate_bytes.load()};
+}
+
+bool FileInfoCollector::VisitDirectory(const FileId& id) {
+  if (directories.Insert(id)) {
+    return true;
+  }
+  skipped_directories.fetch_add(1);
+  return false;
+}
+
+std::pair<FileInfo, bool> FileInfoCollector::DetectInode(const FileId& id, const std::function<FileInfo()>& detect) {
+  auto retval = inodes.GetOrCompute(id, detect);
+  if (not retval.second) {
+    hardlinks.fetch_add(1);
+  }
+  return retval;
+}
+
+std::pair<FileInfo, bool> FileInfoCollector::DetectContent(const Fingerprint& fp,
+                                                           const std::function<FileInfo()>& detect) {
+  auto retval = contents.GetOrCompute(fp, detect);
+  if (not retval.second) {
+    duplicates.fetch_add(1);
+    duplicate_bytes.fetch_add(fp.size);
+  }
+  return retval;
 }
 
 std::vector<std::pair<int, FileInfo>> FileInfoCollector::Summarize() const {
@@ -1,14 +1,30 @@
 #include <scnr/scnr.hpp>
+#include <scnr/thread_pool.hpp>
 #include <scnr/util.hpp>
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <iterator>
+#include <limits>
+#include <memory>
+#include <random>
+#include <sstream>
 #include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 #include <gtest/gtest.h>
+#include <scnr/elf/elf.h>
+#include <scnr/mach-o/fat.h>
+#include <scnr/mach-o/loader.h>
+#include <scnr/pe/pe.h>
 
 TEST(DetectContent, Ascii) {
   auto file = scnr::read_file(std::filesystem::path{"ascii.txt"});
@@ -41,12 +57,794 @@ TEST(DetectContent, All) {
   }
 }
 
+namespace {
+
+// Temporary directory tree removed on scope exit. Every tree gets a directory of its own, creating it fails for
+// a name taken by another test or by a concurrent run
+class TempTree {
+ public:
+  TempTree() {
+    std::random_device random;
+    do {
+      root_ = std::filesystem::temp_directory_path() / ("scnr_lib_tests_" + std::to_string(random()));
+    } while (!std::filesystem::create_directory(root_));
+  }
+
+  ~TempTree() {
+    std::filesystem::remove_all(root_);
+  }
+
+  std::filesystem::path Write(const std::filesystem::path& relative, std::string_view content) {
+    auto path = root_ / relative;
+    std::filesystem::create_directories(path.parent_path());
+    std::ofstream(path, std::ios::binary) << content;
+    return path;
+  }
+
+  const std::filesystem::path& Root() const {
+    return root_;
+  }
+
+ private:
+  std::filesystem::path root_;
+};
+
+std::vector<std::pair<int, scnr::FileInfo>> Scan(const std::filesystem::path& path, const scnr::ScanOptions& options,
+                                                 size_t workers = 4) {
+  scnr::FileInfoCollector collector;
+  scnr::ThreadPool pool(workers);
+  pool.Submit([&] {
+    scnr::process(path, collector, options);
+  });
+  pool.WaitIdle();
+  pool.Stop();
+  return collector.Summarize();
+}
+
+std::string ArMember(std::string_view name, std::string_view data) {
+  char header[61];
+  std::snprintf(header, sizeof(header), "%-16s%-12s%-6s%-6s%-8s%-10zu`\n", std::string(name).c_str(), "0", "0", "0",
+                "644", data.size());
+  return std::string(header, 60) + std::string(data) + (data.size() % 2 ? "\n" : "");
+}
+
+std::string TarMember(std::string_view name, std::string_view data, char type = '0') {
+  std::string header(512, '\0');
+  header.replace(0, name.size(), name);
+  std::snprintf(header.data() + 124, 12, "%011zo", data.size());
+  header[156] = type;
+  header.replace(257, 8, std::string_view("ustar\0" "00", 8));
+  header.replace(148, 8, 8, ' ');
+  unsigned sum = 0;
+  for (unsigned char c : header) {
+    sum += c;
+  }
+  std::snprintf(header.data() + 148, 8, "%06o", sum);
+  return header + std::string(data) + std::string((512 - data.size() % 512) % 512, '\0');
+}
+
+// Whole content of a file of the data directory
+std::string ReadFile(const std::filesystem::path& path) {
+  std::ifstream file(path, std::ios::binary);
+  return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+// detect_content of bytes in memory
+scnr::FileInfo DetectString(const std::string& data) {
+  std::stringstream ss(data);
+  return scnr::detect_content(scnr::StreamData(&ss));
+}
+
+scnr::FileInfo DetectString(const std::string& data, const scnr::ContainerOptions& options) {
+  std::stringstream ss(data);
+  return scnr::detect_content(scnr::StreamData(&ss), options, {});
+}
+
+// Gzip member with a name and an extra field, the content goes into a single stored deflate block
+std::string GzipStored(std::string_view data) {
+  std::string retval("\x1f\x8b\x08\x0c\0\0\0\0\0\xff", 10);
+  retval += std::string("\x03\0xyz", 5) + std::string("name.txt\0", 9);
+  const auto len = static_cast<std::uint16_t>(data.size());
+  retval += std::string{'\x01', char(len & 0xff), char(len >> 8), char(~len & 0xff), char((~len >> 8) & 0xff)};
+  return retval + std::string(data) + std::string(8, '\0');
+}
+
+}  // namespace
+
+TEST(Process, Traversal) {
+  TempTree tree;
+  for (int d = 0; d < 5; ++d) {
+    for (int f = 0; f < 100; ++f) {
+      tree.Write(std::to_string(d) + "/" + std::to_string(d) + "/" + std::to_string(f) + ".txt", "ascii");
+    }
+  }
+  tree.Write("top.txt", "ascii");
+
+  const std::vector<std::pair<int, scnr::FileInfo>> expected{{501, scnr::TxtFile{.encoding = "ASCII"}}};
+  for (auto traversal : {scnr::Traversal::kBreadthFirst, scnr::Traversal::kDepthFirst}) {
+    for (auto order : {scnr::FileOrder::kDirectory, scnr::FileOrder::kInode, scnr::FileOrder::kExtent}) {
+      EXPECT_EQ(Scan(tree.Root(), scnr::ScanOptions{.traversal = traversal, .order = order}), expected);
+      EXPECT_EQ(Scan(tree.Root(), scnr::ScanOptions{.traversal = traversal, .order = order}, 1), expected);
+    }
+  }
+}
+
+#if !defined(_WIN32)
+TEST(Process, HardLinks) {
+  TempTree tree;
+  auto target = tree.Write("a/file.txt", "ascii");
+  std::filesystem::create_directories(tree.Root() / "b");
+  std::filesystem::create_hard_link(target, tree.Root() / "a" / "link.txt");
+  std::filesystem::create_hard_link(target, tree.Root() / "b" / "link.txt");
+  tree.Write("b/other.txt", "ascii");
+
+  const scnr::FileInfo ascii = scnr::TxtFile{.encoding = "ASCII"};
+  using Summary = std::vector<std::pair<int, scnr::FileInfo>>;
+  EXPECT_EQ(Scan(tree.Root(), scnr::ScanOptions{.hardlinks = scnr::HardLinks::kOff}), (Summary{{4, ascii}}));
+  EXPECT_EQ(Scan(tree.Root(), scnr::ScanOptions{.hardlinks = scnr::HardLinks::kCountLinks}), (Summary{{4, ascii}}));
+  EXPECT_EQ(Scan(tree.Root(), scnr::ScanOptions{.hardlinks = scnr::HardLinks::kCountInodes}), (Summary{{2, ascii}}));
+
+  scnr::FileInfoCollector collector;
+  scnr::ScanOptions options{.hardlinks = scnr::HardLinks::kCountInodes};
+  scnr::process(tree.Root(), collector, options);
+  scnr::process(tree.Root() / "b", collector, options);
+  EXPECT_EQ(collector.Summarize(), (Summary{{2, ascii}}));
+  EXPECT_EQ(collector.Stats().hardlinks, 2);
+  EXPECT_EQ(collector.Stats().directories, 1);
+}
+
+TEST(Process, Symlinks) {
+  TempTree tree;
+  auto file = tree.Write("tree/a/file.txt", "ascii");
+  tree.Write("ext/file.txt", "ascii");
+  const auto root = tree.Root() / "tree";
+  std::filesystem::create_directory_symlink("..", root / "a" / "loop");
+  std::filesystem::create_directory_symlink(root / "a", root / "dirlink");
+  std::filesystem::create_directory_symlink(tree.Root() / "ext", root / "extlink");
+  std::filesystem::create_symlink(file, root / "filelink");
+  std::filesystem::create_symlink(root / "nonexist", root / "broken");
+
+  const scnr::FileInfo ascii = scnr::TxtFile{.encoding = "ASCII"};
+  using Summary = std::vector<std::pair<int, scnr::FileInfo>>;
+  for (auto traversal : {scnr::Traversal::kBreadthFirst, scnr::Traversal::kDepthFirst}) {
+    EXPECT_EQ(Scan(root, scnr::ScanOptions{.traversal = traversal, .follow = scnr::Follow::kNever}),
+              (Summary{{1, ascii}}));
+    EXPECT_EQ(Scan(root, scnr::ScanOptions{.traversal = traversal, .follow = scnr::Follow::kFiles}),
+              (Summary{{2, ascii}}));
+    EXPECT_EQ(Scan(root, scnr::ScanOptions{.traversal = traversal, .follow = scnr::Follow::kAll}),
+              (Summary{{3, ascii}}));
+  }
+
+  scnr::FileInfoCollector collector;
+  scnr::process(root, collector, scnr::ScanOptions{.follow = scnr::Follow::kAll});
+  EXPECT_EQ(collector.Stats().directories, 2);
+}
+#endif
+
+TEST(Process, DedupContent) {
+  TempTree tree;
+  for (auto dir : {"a", "b", "c"}) {
+    std::filesystem::create_directories(tree.Root() / dir);
+    std::filesystem::copy_file("amd64.exe", tree.Root() / dir / "amd64.exe");
+  }
+  tree.Write("a/big.txt", std::string(100000, 'a'));
+  tree.Write("b/big.txt", std::string(100000, 'a') + "b");
+
+  scnr::FileInfoCollector collector;
+  scnr::process(tree.Root(), collector, scnr::ScanOptions{.dedup_content = true});
+  using Summary = std::vector<std::pair<int, scnr::FileInfo>>;
+  EXPECT_EQ(collector.Summarize(),
+            (Summary{{3, scnr::PEFile{.endian = std::endian::little,
+                                      .w64 = true,
+                                      .cputype = "AMD64",
+                                      .subsystem = "WINDOWS_CUI"}},
+                     {2, scnr::TxtFile{.encoding = "ASCII"}}}));
+  EXPECT_EQ(collector.Stats().duplicates, 2);
+  EXPECT_EQ(collector.Stats().duplicate_bytes, 2 * std::filesystem::file_size("amd64.exe"));
+
+  // copies are searched for embedded payloads once, with the file whose result they reuse
+  std::atomic<int> searched = 0;
+  scnr::ScanOptions embedded{.dedup_content = true};
+  embedded.on_embedded = [&](const std::filesystem::path&, const std::vector<scnr::EmbeddedFile>&) {
+    searched += 1;
+  };
+  scnr::FileInfoCollector second;
+  scnr::process(tree.Root(), second, embedded);
+  EXPECT_EQ(searched, 3);
+}
+
+TEST(Process, Cancellation) {
+  TempTree tree;
+  tree.Write("a.txt", "ascii");
+  tree.Write("b/b.txt", "ascii");
+
+  using Summary = std::vector<std::pair<int, scnr::FileInfo>>;
+  EXPECT_EQ(Scan(tree.Root(), scnr::ScanOptions{.file_timeout = std::chrono::milliseconds(0)}),
+            (Summary{{2, scnr::TimedOutFile{}}}));
+
+  // the deadline counts as hit only once a check has seen it pass
+  scnr::Context late;
+  late.SetDeadline(scnr::Clock::now());
+  EXPECT_FALSE(late.Stopped());
+  EXPECT_TRUE(late.StopRequested());
+  EXPECT_TRUE(late.DeadlineHit());
+  EXPECT_TRUE(late.Stopped());
+
+  scnr::Context ctx;
+  ctx.RequestStop();
+  EXPECT_FALSE(ctx.DeadlineHit());
+  EXPECT_EQ(Scan(tree.Root(), scnr::ScanOptions{.ctx = &ctx}), Summary{});
+
+  scnr::CancelToken token(&ctx);
+  auto file = scnr::read_file("ascii.txt");
+  EXPECT_THROW(scnr::detect_content(scnr::StreamData(file).cancellable(&token)), scnr::Cancelled);
+}
+
+TEST(Pathological, MachOZeroCmdSize) {
+  // a command of the given size, then LC_BUILD_VERSION at offset 16. A size below the command header stops the
+  // walk: 0 would read the same command ncmds times, 4 would go on with the word at offset 8 as the next size
+  auto platform = [](std::uint32_t cmdsize) {
+    const std::uint32_t sizeofcmds = 16 + sizeof(build_version_command);
+    std::string data(4096, '\0');
+    const mach_header_64 header{.magic = MH_MAGIC_64,
+                                .cputype = CPU_TYPE_X86_64,
+                                .filetype = MH_EXECUTE,
+                                .ncmds = 3,
+                                .sizeofcmds = sizeofcmds};
+    std::memcpy(data.data(), &header, sizeof(header));
+    const load_command lc{.cmd = LC_UUID, .cmdsize = cmdsize};
+    std::memcpy(data.data() + sizeof(header), &lc, sizeof(lc));
+    const std::uint32_t next_size = 12;
+    std::memcpy(data.data() + sizeof(header) + 8, &next_size, sizeof(next_size));
+    const build_version_command build{
+      .cmd = LC_BUILD_VERSION, .cmdsize = sizeof(build_version_command), .platform = PLATFORM_MACOS};
+    std::memcpy(data.data() + sizeof(header) + 16, &build, sizeof(build));
+
+    std::stringstream ss(data);
+    auto macho = scnr::try_macho(scnr::StreamData(&ss));
+    EXPECT_TRUE(macho.has_value());
+    return macho ? std::get<scnr::MachOSingle>(macho->value).platform : "";
+  };
+  EXPECT_EQ(platform(16), "MACOS");
+  EXPECT_EQ(platform(0), "");
+  EXPECT_EQ(platform(4), "");
+  EXPECT_EQ(platform(4096), "");
+}
+
+TEST(Pathological, MachOFatSliceSize) {
+  // a single slice at 4096 whose load commands end past the size the arch table gives it
+  auto fat = [](std::uint32_t size) {
+    std::string data(8192, '\0');
+    const fat_header header{.magic = FAT_MAGIC, .nfat_arch = 1};
+    std::memcpy(data.data(), &header, sizeof(header));
+    const fat_arch arch{.cputype = CPU_TYPE_X86_64, .offset = 4096, .size = size};
+    std::memcpy(data.data() + sizeof(header), &arch, sizeof(arch));
+    const mach_header_64 slice{.magic = MH_MAGIC_64,
+                               .cputype = CPU_TYPE_X86_64,
+                               .filetype = MH_EXECUTE,
+                               .ncmds = 1,
+                               .sizeofcmds = sizeof(build_version_command)};
+    std::memcpy(data.data() + 4096, &slice, sizeof(slice));
+    const build_version_command build{
+      .cmd = LC_BUILD_VERSION, .cmdsize = sizeof(build_version_command), .platform = PLATFORM_MACOS};
+    std::memcpy(data.data() + 4096 + sizeof(slice), &build, sizeof(build));
+    std::stringstream ss(data);
+    return scnr::try_macho(scnr::StreamData(&ss));
+  };
+  auto whole = fat(sizeof(mach_header_64) + sizeof(build_version_command));
+  ASSERT_TRUE(whole.has_value());
+  EXPECT_EQ(std::get<scnr::MachOFat>(whole->value).files.at(0).platform, "MACOS");
+  EXPECT_FALSE(fat(sizeof(mach_header_64) + 8).has_value());
+}
+
+TEST(Pathological, ElfManyProgramHeaders) {
+  std::string data(sizeof(Elf64_Ehdr) + 60000 * sizeof(Elf64_Phdr), '\0');
+  Elf64_Ehdr header{.e_ident = {ELFMAG0, ELFMAG1, ELFMAG2, ELFMAG3, ELFCLASS64,
+                                std::endian::native == std::endian::little ? ELFDATA2LSB : ELFDATA2MSB},
+                    .e_machine = EM_AARCH64,
+                    .e_phoff = sizeof(Elf64_Ehdr),
+                    .e_phentsize = sizeof(Elf64_Phdr),
+                    .e_phnum = 60000};
+  std::memcpy(data.data(), &header, sizeof(header));
+
+  std::stringstream ss(data);
+  EXPECT_EQ(scnr::try_elf(scnr::StreamData(&ss)),
+            (scnr::ElfFile{.endian = std::endian::native, .w64 = true, .cputype = "AARCH64", .stripped = true}));
+}
+
+TEST(Elf, ManySections) {
+  // .symtab near the end of a table larger than one read, as -ffunction-sections objects have it
+  auto object = [](size_t shnum, std::optional<size_t> symtab) {
+    std::string data(sizeof(Elf64_Ehdr) + shnum * sizeof(Elf64_Shdr), '\0');
+    Elf64_Ehdr header{.e_ident = {ELFMAG0, ELFMAG1, ELFMAG2, ELFMAG3, ELFCLASS64,
+                                  std::endian::native == std::endian::little ? ELFDATA2LSB : ELFDATA2MSB},
+                      .e_type = ET_REL,
+                      .e_machine = EM_X86_64,
+                      .e_shoff = sizeof(Elf64_Ehdr),
+                      .e_shentsize = sizeof(Elf64_Shdr),
+                      .e_shnum = static_cast<Elf64_Half>(shnum)};
+    std::memcpy(data.data(), &header, sizeof(header));
+    if (symtab) {
+      const Elf64_Shdr section{.sh_type = SHT_SYMTAB};
+      std::memcpy(data.data() + sizeof(Elf64_Ehdr) + symtab.value() * sizeof(Elf64_Shdr), &section, sizeof(section));
+    }
+    std::stringstream ss(data);
+    return scnr::try_elf(scnr::StreamData(&ss)).value().stripped;
+  };
+  EXPECT_FALSE(object(1511, 1508));
+  EXPECT_FALSE(object(1511, 3));
+  EXPECT_TRUE(object(1511, std::nullopt));
+  EXPECT_FALSE(object(10, 8));
+  EXPECT_TRUE(object(10, std::nullopt));
+}
+
+TEST(Elf, Details) {
+  auto elf = scnr::try_elf(scnr::read_file(std::filesystem::path{"elf-64-x86.elf"}));
+  ASSERT_TRUE(elf.has_value());
+  EXPECT_FALSE(elf->stripped);
+  const std::vector<std::string> needed = {"libstdc++.so.6", "libm.so.6", "libgcc_s.so.1", "libc.so.6"};
+  EXPECT_EQ(elf->details.needed, needed);
+  EXPECT_EQ(elf->details.soname, "");
+  EXPECT_EQ(elf->details.build_id, "778a1fbc86f1d5cfd7d6dc00686b1028dbdebf48");
+
+  // details identify a single binary, the summary key does not include them
+  auto other = elf.value();
+  other.details = {};
+  EXPECT_NE(other, elf.value());
+  EXPECT_EQ(scnr::summary_key(other), scnr::summary_key(elf.value()));
+  EXPECT_EQ(std::hash<scnr::FileInfo>{}(other), std::hash<scnr::FileInfo>{}(elf.value()));
+}
+
+TEST(PE, Details) {
+  auto pe = scnr::try_pe(scnr::read_file(std::filesystem::path{"amd64.exe"}));
+  ASSERT_TRUE(pe.has_value());
+  EXPECT_FALSE(pe->issigned);
+  EXPECT_EQ(pe->details.dll_characteristics, IMAGE_DLLCHARACTERISTICS_HIGH_ENTROPY_VA |
+                                               IMAGE_DLLCHARACTERISTICS_DYNAMIC_BASE |
+                                               IMAGE_DLLCHARACTERISTICS_NX_COMPAT |
+                                               IMAGE_DLLCHARACTERISTICS_TERMINAL_SERVER_AWARE);
+  EXPECT_EQ(pe->details.imports, std::vector<std::string>{"KERNEL32.dll"});
+}
+
+TEST(MachO, Details) {
+  auto macho = scnr::try_macho(scnr::read_file(std::filesystem::path{"arm64-test"}));
+  ASSERT_TRUE(macho.has_value());
+  const auto& single = std::get<scnr::MachOSingle>(macho->value);
+  EXPECT_EQ(single.platform, "MACOS");
+  EXPECT_EQ(single.details.dylibs, std::vector<std::string>{"/usr/lib/libSystem.B.dylib"});
+  EXPECT_EQ(single.details.id, "");
+  EXPECT_EQ(single.details.uuid, "A45ED1B8-4F14-3299-B1D0-CB0BCA4A690F");
+  EXPECT_EQ(single.details.minos, "13.0");
+  EXPECT_EQ(single.details.signature_size, 407);
+}
+
+TEST(MachO, Subtypes) {
+  auto single = [](cpu_type_t cputype, cpu_subtype_t cpusubtype) {
+    std::string data(4096, '\0');
+    const mach_header_64 header{.magic = MH_MAGIC_64, .cputype = cputype, .cpusubtype = cpusubtype};
+    std::memcpy(data.data(), &header, sizeof(header));
+    std::stringstream ss(data);
+    return std::get<scnr::MachOSingle>(scnr::try_macho(scnr::StreamData(&ss))->value);
+  };
+
+  // the pointer authentication ABI bits do not change the subtype
+  const auto arm64e = single(CPU_TYPE_ARM64, CPU_SUBTYPE_ARM64E | CPU_SUBTYPE_PTRAUTH_ABI);
+  EXPECT_EQ(arm64e.cputype, "ARM64");
+  EXPECT_EQ(arm64e.cpusubtype, "ARM64E");
+  EXPECT_NE(arm64e, single(CPU_TYPE_ARM64, CPU_SUBTYPE_ARM64_ALL));
+  const auto haswell = single(CPU_TYPE_X86_64, CPU_SUBTYPE_X86_64_H);
+  EXPECT_EQ(haswell.cpusubtype, "X86_64_H");
+  // only specific subtypes are printed
+  std::stringstream specific, all;
+  specific << haswell;
+  all << single(CPU_TYPE_X86_64, CPU_SUBTYPE_X86_64_ALL | CPU_SUBTYPE_LIB64);
+  EXPECT_NE(specific.str().find("X86_64, X86_64_H, x64"), std::string::npos);
+  EXPECT_NE(all.str().find("X86_64, x64"), std::string::npos);
+  // subtypes are numbered per CPU type
+  EXPECT_EQ(single(CPU_TYPE_POWERPC, CPU_SUBTYPE_POWERPC_970).cpusubtype, "POWERPC_970");
+  EXPECT_EQ(single(CPU_TYPE_ARM64, CPU_SUBTYPE_POWERPC_970).cpusubtype, "");
+}
+
+TEST(Archive, Members) {
+  const std::string elf_data = ReadFile("elf-64-x86.elf");
+
+  const std::string ar = "!<arch>\n" + ArMember("/", "symbols") + ArMember("text.txt/", "hello") +
+                         ArMember("prog/", elf_data);
+  const std::string tar = TarMember("dir/", "", '5') + TarMember("lib.a", ar) + TarMember("a.txt", "abc") +
+                          std::string(1024, '\0');
+
+  auto scan = [](const std::string& data, const scnr::ContainerOptions& options) {
+    std::stringstream ss(data);
+    std::unordered_map<scnr::MemberInfo, int> members;
+    auto fileinfo = scnr::detect_content(scnr::StreamData(&ss), options, [&](const scnr::MemberInfo& member) {
+      members[{.container = member.container, .info = scnr::summary_key(member.info)}] += 1;
+    });
+    return std::make_pair(fileinfo, members);
+  };
+  const scnr::FileInfo txt = scnr::TxtFile{.encoding = "ASCII"};
+  const scnr::FileInfo exe = scnr::ElfFile{
+    .endian = std::endian::little, .w64 = true, .cputype = "X86_64", .interpreter = "/lib64/ld-linux-x86-64.so.2"};
+
+  // the symbol table is skipped, members do not run into each other
+  auto [ar_info, ar_members] = scan(ar, {});
+  EXPECT_EQ(ar_info, scnr::FileInfo{(scnr::ArchiveFile{.format = "ar", .details = {.members = 2}})});
+  EXPECT_EQ(ar_members.size(), 2);
+  EXPECT_EQ((ar_members[{.container = "ar", .info = txt}]), 1);
+  EXPECT_EQ((ar_members[{.container = "ar", .info = exe}]), 1);
+
+  auto [tar_info, tar_members] = scan(tar, {.max_depth = 2});
+  EXPECT_EQ(tar_info, scnr::FileInfo{(scnr::ArchiveFile{.format = "tar", .details = {.members = 2}})});
+  EXPECT_EQ((tar_members[{.container = "tar", .info = scnr::ArchiveFile{.format = "ar"}}]), 1);
+  EXPECT_EQ((tar_members[{.container = "tar", .info = txt}]), 1);
+  EXPECT_EQ((tar_members[{.container = "ar", .info = exe}]), 1);
+
+  // nested archives below the depth are only identified
+  auto [shallow_info, shallow_members] = scan(tar, {.max_depth = 1});
+  EXPECT_EQ(shallow_members.size(), 2);
+
+  auto [limited_info, limited_members] = scan(tar, {.max_depth = 1, .max_members = 1});
+  EXPECT_TRUE(std::get<scnr::ArchiveFile>(limited_info).details.truncated);
+  EXPECT_EQ(limited_members.size(), 1);
+
+  auto [plain_info, plain_members] = scan(tar, {.max_depth = 0});
+  EXPECT_EQ(plain_info, scnr::FileInfo{scnr::ArchiveFile{.format = "tar"}});
+  EXPECT_TRUE(plain_members.empty());
+}
+
+TEST(Archive, Zip) {
+  const std::string jar_data = ReadFile("hello.jar");
+
+  std::vector<scnr::MemberInfo> members;
+  auto scan = [&](const std::string& data) {
+    members.clear();
+    std::stringstream ss(data);
+    return scnr::detect_content(scnr::StreamData(&ss), {}, [&](const scnr::MemberInfo& member) {
+      members.push_back({.container = member.container, .info = scnr::summary_key(member.info)});
+    });
+  };
+
+  // the manifest and the ELF are deflated, the text is stored, the directory is skipped
+  auto info = scan(jar_data);
+  EXPECT_EQ(info, scnr::FileInfo{(scnr::ArchiveFile{.format = "jar", .details = {.members = 3}})});
+  const scnr::FileInfo exe = scnr::ElfFile{
+    .endian = std::endian::little, .w64 = true, .cputype = "X86_64", .interpreter = "/lib64/ld-linux-x86-64.so.2"};
+  EXPECT_EQ(std::count(members.begin(), members.end(), scnr::MemberInfo{.container = "jar", .info = exe}), 1);
+  EXPECT_EQ(std::count(members.begin(), members.end(),
+                       scnr::MemberInfo{.container = "jar", .info = scnr::TxtFile{.encoding = "ASCII"}}),
+            2);
+
+  // offsets stay relative to the archive start when something is prepended
+  std::string prepended = jar_data;
+  prepended.replace(0, 0, "PK\3\4" + std::string(100, 'x'));
+  EXPECT_EQ(std::get<scnr::ArchiveFile>(scan(prepended)).details.members, 3);
+  EXPECT_EQ(scan(jar_data.substr(0, jar_data.size() - 1)), scnr::FileInfo{});
+}
+
+TEST(Compressed, Gzip) {
+  auto content = [](const scnr::FileInfo& info) {
+    return std::make_shared<const scnr::CompressedContent>(scnr::CompressedContent{info});
+  };
+  const scnr::FileInfo txt = scnr::TxtFile{.encoding = "ASCII"};
+  const scnr::FileInfo gzip_txt = scnr::CompressedFile{.format = "gzip", .content = content(txt)};
+
+  auto file = scnr::read_file("elf-64-x86.elf.gz");
+  const scnr::FileInfo exe = scnr::ElfFile{
+    .endian = std::endian::little, .w64 = true, .cputype = "X86_64", .interpreter = "/lib64/ld-linux-x86-64.so.2"};
+  const scnr::FileInfo gzip_exe = scnr::CompressedFile{.format = "gzip", .content = content(exe)};
+  EXPECT_EQ(scnr::summary_key(scnr::detect_content(file)), gzip_exe);
+
+  EXPECT_EQ(DetectString(GzipStored("hello"), {}), gzip_txt);
+  // only the content up to the cap is looked at
+  EXPECT_EQ(DetectString(GzipStored(std::string(100, 'a') + std::string(100, '\0')), {.max_decompressed = 100}),
+            gzip_txt);
+  // nested compressed content is identified only
+  const scnr::FileInfo gzip = scnr::CompressedFile{.format = "gzip"};
+  const scnr::FileInfo gzip_gzip = scnr::CompressedFile{.format = "gzip", .content = content(gzip)};
+  EXPECT_EQ(DetectString(GzipStored(GzipStored("hello")), {}), gzip_gzip);
+  EXPECT_EQ(DetectString(std::string("\xfd" "7zXZ\0\0\x04", 8), {}),
+            scnr::FileInfo{scnr::CompressedFile{.format = "xz"}});
+  EXPECT_EQ(DetectString("\x28\xb5\x2f\xfd\x24", {}), scnr::FileInfo{scnr::CompressedFile{.format = "zstd"}});
+}
+
+TEST(Embedded, Payloads) {
+  const std::string exe = ReadFile("amd64.exe");
+  const std::string elf = ReadFile("elf-64-x86.elf");
+  const std::string jar = ReadFile("hello.jar");
+  auto find = [](const std::string& data) {
+    std::stringstream ss(data);
+    return scnr::find_embedded(scnr::StreamData(&ss));
+  };
+
+  // magic numbers without a valid header behind them are skipped, the tar member and the jar members are
+  // not reported again, the ELF crosses the boundary of the first chunk
+  const std::string stub = "firmware: MZ, \x7f" "ELF and PK\3\4 are text here\n";
+  const std::string tar = TarMember("a.txt", "abc") + TarMember("b.txt", "def") + std::string(1024, '\0');
+  std::string firmware = stub + exe + tar;
+  const size_t elf_offset = 1024 * 1024 - 2;
+  firmware.resize(elf_offset, '\xff');
+  firmware += elf + GzipStored(std::string(100, 'a')) + jar;
+
+  const auto payloads = find(firmware);
+  std::vector<std::pair<size_t, size_t>> found;
+  for (const auto& payload : payloads) {
+    found.emplace_back(payload.offset, payload.info.index());
+  }
+  const size_t tar_offset = stub.size() + exe.size();
+  const size_t gzip_offset = elf_offset + elf.size();
+  const std::vector<std::pair<size_t, size_t>> expected = {
+    {stub.size(), scnr::FileInfo(scnr::PEFile{}).index()},
+    {tar_offset, scnr::FileInfo(scnr::ArchiveFile{}).index()},
+    {elf_offset, scnr::FileInfo(scnr::ElfFile{}).index()},
+    {gzip_offset, scnr::FileInfo(scnr::CompressedFile{}).index()},
+    {gzip_offset + GzipStored(std::string(100, 'a')).size(), scnr::FileInfo(scnr::ArchiveFile{}).index()}};
+  ASSERT_EQ(found, expected);
+  EXPECT_EQ(payloads[1].info, scnr::FileInfo{scnr::ArchiveFile{.format = "tar"}});
+  EXPECT_EQ(payloads[4].info, scnr::FileInfo{scnr::ArchiveFile{.format = "jar"}});
+
+  // the file itself is not embedded in itself
+  EXPECT_TRUE(find(jar).empty());
+  EXPECT_TRUE(find(tar).empty());
+  // member headers are skipped up to the end of their archive only, a second tar is a payload of its own
+  const auto tars = find(tar + stub + tar);
+  ASSERT_EQ(tars.size(), 1);
+  EXPECT_EQ(tars[0].offset, tar.size() + stub.size());
+  EXPECT_TRUE(find(std::string(100, '\0') + "MZ").empty());
+}
+
+TEST(Encoding, Utf16) {
+  // "text" and U+1F600 as surrogate pair, little-endian
+  const std::string text("t\0e\0x\0t\0", 8);
+  const std::string emoji("\x3d\xd8\x00\xde", 4);
+  auto big = [](std::string le) {
+    for (size_t i = 0; i + 1 < le.size(); i += 2) {
+      std::swap(le[i], le[i + 1]);
+    }
+    return le;
+  };
+
+  const scnr::FileInfo le_bom = scnr::TxtFile{.encoding = "UTF-16-LE", .withbom = true};
+  EXPECT_EQ(DetectString("\xff\xfe" + text + emoji), le_bom);
+  const scnr::FileInfo be_bom = scnr::TxtFile{.encoding = "UTF-16-BE", .withbom = true};
+  EXPECT_EQ(DetectString(big("\xff\xfe" + text + emoji)), be_bom);
+  // the pair straddles SIMD blocks and read chunks
+  std::string long_text;
+  for (int i = 0; i < 2047; ++i) {
+    long_text += std::string(" \0", 2);
+  }
+  long_text += emoji + text;
+  EXPECT_EQ(DetectString(long_text), (scnr::FileInfo{scnr::TxtFile{.encoding = "UTF-16-LE"}}));
+  EXPECT_EQ(DetectString(big(long_text)), (scnr::FileInfo{scnr::TxtFile{.encoding = "UTF-16-BE"}}));
+  // unpaired surrogates
+  const std::string bom("\xff\xfe");
+  EXPECT_EQ(DetectString(bom + text + emoji.substr(0, 2) + text), scnr::FileInfo{});
+  EXPECT_EQ(DetectString(bom + text + emoji.substr(2) + text), scnr::FileInfo{});
+  EXPECT_EQ(DetectString(bom + text + emoji.substr(0, 2)), scnr::FileInfo{});
+  // 8-bit text of even length is no UTF-16 without units below U+0100
+  EXPECT_EQ(DetectString("Z\xfcrich, \xa3" "100"), (scnr::FileInfo{scnr::TxtFile{.encoding = "iso-8859-1"}}));
+}
+
+TEST(Encoding, Utf32) {
+  // BOM, "text" and U+E0001 of a supplementary plane, little-endian
+  std::string text("\xff\xfe\0\0t\0\0\0e\0\0\0x\0\0\0t\0\0\0\x01\0\x0e\0", 24);
+  EXPECT_EQ(DetectString(text), (scnr::FileInfo{scnr::TxtFile{.encoding = "UTF-32-LE", .withbom = true}}));
+  // more than one SIMD block without BOM
+  EXPECT_EQ(DetectString(text.substr(4) + text.substr(4) + text.substr(4)),
+            (scnr::FileInfo{scnr::TxtFile{.encoding = "UTF-32-LE"}}));
+  // surrogates are no code points, a trailing partial unit is no text
+  EXPECT_EQ(DetectString(text + std::string("\0\xd8\0\0", 4)), scnr::FileInfo{});
+  EXPECT_EQ(DetectString(text + "t"), scnr::FileInfo{});
+}
+
+TEST(Encoding, Controls) {
+  // ANSI colors of a log are text, NULs are not
+  const std::string log = "ok \x1b[32mPASS\x1b[0m\n";
+  EXPECT_EQ(DetectString(log), (scnr::FileInfo{scnr::TxtFile{.encoding = "UTF-8"}}));
+  EXPECT_EQ(DetectString(log + "\xc3\xa9\n"), (scnr::FileInfo{scnr::TxtFile{.encoding = "UTF-8"}}));
+  EXPECT_NE(DetectString(log + std::string(1, '\0')), (scnr::FileInfo{scnr::TxtFile{.encoding = "UTF-8"}}));
+  std::string utf16 = "\xff\xfe", utf32 = std::string("\xff\xfe\0\0", 4);
+  for (char c : log) {
+    utf16 += std::string{c, '\0'};
+    utf32 += std::string{c, '\0', '\0', '\0'};
+  }
+  EXPECT_EQ(DetectString(utf16), (scnr::FileInfo{scnr::TxtFile{.encoding = "UTF-16-LE", .withbom = true}}));
+  EXPECT_EQ(DetectString(utf32), (scnr::FileInfo{scnr::TxtFile{.encoding = "UTF-32-LE", .withbom = true}}));
+}
+
+TEST(Encoding, Data) {
+  auto data = [](const std::string& bytes, const scnr::DataHeuristic& heuristic = {}) {
+    std::stringstream ss(bytes);
+    return scnr::try_data(scnr::StreamData(&ss), heuristic);
+  };
+
+  // 64-bit little endian integers, every lane has its share of NULs
+  std::string ints;
+  for (std::uint64_t i = 0; i < 500; ++i) {
+    const std::uint64_t value = scnr::LEToHost(i * 37);
+    ints.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+  EXPECT_TRUE(data(ints));
+  std::stringstream ss(ints);
+  EXPECT_EQ(scnr::detect_content(scnr::StreamData(&ss), {}, {}), scnr::FileInfo{scnr::DataFile{}});
+  EXPECT_FALSE(data(ints, {.head = 0}));
+  EXPECT_FALSE(data(ints, {.nul_percent = 100}));
+  EXPECT_FALSE(data(ints.substr(0, 63)));
+
+  // the NULs of UTF-16 and UTF-32 text stay in some of the lanes
+  for (const char* path : {"utf16-le.txt", "utf16-be.txt", "utf32-le.txt", "utf32-be-bom.txt", "elf-64-x86.elf.gz"}) {
+    EXPECT_FALSE(data(ReadFile(path))) << path;
+  }
+  EXPECT_TRUE(data(ReadFile("elf-64-x86.elf")));
+}
+
+TEST(Xml, Declaration) {
+  auto xml = [](const std::string& data, size_t max_validated = scnr::kXmlValidatedPrefix) {
+    std::stringstream ss(data);
+    return scnr::try_xml(scnr::StreamData(&ss), max_validated);
+  };
+  auto utf16 = [](std::string_view text, bool bigendian) {
+    std::string retval;
+    for (char c : text) {
+      retval += bigendian ? std::string{'\0', c} : std::string{c, '\0'};
+    }
+    return retval;
+  };
+  const std::string decl = "<?xml version='1.0' encoding = 'UTF-16'?>\n<a/>\n";
+
+  auto le = xml(utf16(decl, false));
+  ASSERT_TRUE(le);
+  EXPECT_EQ(le.value(), (scnr::XmlFile{.encoding = "UTF-16-LE", .details = {.declared = "UTF-16"}}));
+  auto be = xml("\xfe\xff" + utf16(decl, true));
+  ASSERT_TRUE(be);
+  EXPECT_EQ(be.value(), (scnr::XmlFile{.encoding = "UTF-16-BE", .details = {.declared = "UTF-16"}}));
+  EXPECT_FALSE(xml(utf16("<?xm", false) + "l"));
+
+  // only the prefix is validated unless the whole file is asked for
+  const std::string binary_tail = "<?xml version=\"1.0\"?>" + std::string(100, ' ') + std::string(2, '\0');
+  auto prefix = xml(binary_tail, 64);
+  ASSERT_TRUE(prefix);
+  EXPECT_EQ(prefix.value(), scnr::XmlFile{.encoding = "ASCII"});
+  EXPECT_FALSE(xml(binary_tail, std::numeric_limits<size_t>::max()));
+}
+
+TEST(Script, Shebang) {
+  auto script = [](const std::string& data, bool check_encoding = false) {
+    std::stringstream ss(data);
+    return scnr::try_script(scnr::StreamData(&ss), check_encoding);
+  };
+
+  auto sh = script("#!/bin/sh\r\necho hi\n");
+  ASSERT_TRUE(sh);
+  EXPECT_EQ(sh.value(), (scnr::ScriptFile{.interpreter = "sh", .details = {.path = "/bin/sh"}}));
+
+  auto env = script("#! /usr/bin/env -S PYTHONUTF8=1 python3 -u \nprint()\n");
+  ASSERT_TRUE(env);
+  const scnr::ScriptDetails env_details{.path = "/usr/bin/env", .arguments = "-S PYTHONUTF8=1 python3 -u"};
+  EXPECT_EQ(env.value(), (scnr::ScriptFile{.interpreter = "python3", .details = env_details}));
+
+  auto utf8 = script("#!/usr/bin/perl\nprint \"\xc3\xa9\";\n", true);
+  ASSERT_TRUE(utf8);
+  EXPECT_EQ(utf8.value(),
+            (scnr::ScriptFile{.interpreter = "perl", .encoding = "UTF-8", .details = {.path = "/usr/bin/perl"}}));
+  auto binary = script("#!/bin/sh\nexit 0\n" + std::string(4, '\0'), true);
+  ASSERT_TRUE(binary);
+  EXPECT_EQ(binary.value().encoding, "binary");
+
+  EXPECT_FALSE(script("# !/bin/sh\n"));
+  EXPECT_FALSE(script("#!\n"));
+  EXPECT_FALSE(script(std::string("#!\x7f" "ELF\1\0", 8)));
+}
+
+TEST(Bytecode, Headers) {
+
+  EXPECT_EQ(DetectString(std::string("\0asm\1\0\0\0\1", 9)), scnr::FileInfo{scnr::WasmFile{.version = 1}});
+  EXPECT_EQ(DetectString(std::string("\0asm\x0d\0\1\0", 8)),
+            scnr::FileInfo{(scnr::WasmFile{.version = 13, .component = true})});
+  EXPECT_EQ(DetectString(std::string("\xca\xfe\xba\xbe\0\0\0\x3d\0\x10", 10)),
+            scnr::FileInfo{scnr::JavaClassFile{.major = 61}});
+  std::string dex = std::string("dex\n039\0", 8) + std::string(0x20, '\0') + std::string("\x78\x56\x34\x12", 4);
+  EXPECT_EQ(DetectString(dex), scnr::FileInfo{scnr::DexFile{.version = 39}});
+  dex[0x28] = 0;
+  EXPECT_NE(DetectString(dex), scnr::FileInfo{scnr::DexFile{.version = 39}});
+
+  const std::string bc = ReadFile("hello.bc");
+  auto bitcode = DetectString(bc);
+  ASSERT_EQ(scnr::summary_key(bitcode), scnr::FileInfo{scnr::BitcodeFile{.triple = "x86_64-pc-linux-gnu"}});
+  EXPECT_EQ(std::get<scnr::BitcodeFile>(bitcode).details.producer.substr(0, 4), "LLVM");
+  // wrapper: magic, version, offset, size and cputype
+  std::string wrapped("\xde\xc0\x17\x0b\0\0\0\0\x14\0\0\0\0\0\0\0\x07\0\0\x01", 20);
+  wrapped[12] = static_cast<char>(bc.size() & 0xff);
+  wrapped[13] = static_cast<char>(bc.size() >> 8);
+  EXPECT_EQ(DetectString(wrapped + bc), bitcode);
+  EXPECT_EQ(scnr::summary_key(DetectString(bc.substr(0, 64))), scnr::FileInfo{scnr::BitcodeFile{}});
+
+  const scnr::FileInfo obj = scnr::CoffFile{.cputype = "AMD64", .format = "object"};
+  EXPECT_EQ(DetectString(ReadFile("hello.obj")), obj);
+  EXPECT_NE(DetectString(ReadFile("hello.obj").substr(0, 100)), obj);
+  std::string import("\0\0\xff\xff\0\0\x64\x86\0\0\0\0\x0a\0\0\0\0\0\0\0main\0a.dll\0", 30);
+  EXPECT_EQ(DetectString(import), scnr::FileInfo{(scnr::CoffFile{.cputype = "AMD64", .format = "import"})});
+}
+
+TEST(Custom, Rules) {
+  auto parse = [](const std::string& text) {
+    std::stringstream ss(text);
+    return std::make_shared<const scnr::MagicRules>(scnr::MagicRules::Parse(ss));
+  };
+  const auto rules = parse(R"(# in-house formats
+0     41434d45          acme
+0     41434d4501        acme v1
+0x10  cafe00d0/ffff00ff acme firmware
+0     7f454c46          elf, but ours
+4     00000000/00000000 eight bytes
+)");
+  ASSERT_EQ(rules->size(), 5);
+  EXPECT_EQ(rules->HeadSize(), 20);
+
+  auto custom = [](std::string name) {
+    return scnr::FileInfo{scnr::CustomFile{.name = std::move(name)}};
+  };
+  // the first matching rule in file order wins, whatever group it is in
+  EXPECT_EQ(DetectString("ACME\1 and more", {.rules = rules}), custom("acme"));
+  EXPECT_EQ(DetectString("ACMx" + std::string(12, ' ') + "\xca\xfe\x12\xd0", {.rules = rules}),
+            custom("acme firmware"));
+  EXPECT_EQ(DetectString("ACMx" + std::string(12, ' ') + "\xca\xfe\x12\xd1", {.rules = rules}),
+            custom("eight bytes"));
+  // rules come before the built-in detectors, short heads match rules that fit
+  auto elf = scnr::read_file("elf-64-x86.elf");
+  EXPECT_EQ(scnr::detect_content(elf, {.rules = rules}, {}), custom("elf, but ours"));
+  EXPECT_EQ(DetectString("ACME", {.rules = rules}), custom("acme"));
+  EXPECT_EQ(DetectString("ACM", {.rules = rules}), scnr::FileInfo{scnr::TxtFile{.encoding = "ASCII"}});
+
+  std::stringstream printed;
+  printed << custom("acme");
+  EXPECT_EQ(printed.str(), "custom = [acme]");
+
+  for (const char* bad :
+       {"0 41434d4 odd", "0 4143/ff mask", "x1 4143 offset", "0 zz name", "0 4143", "65535 4143 far"}) {
+    EXPECT_THROW(parse(bad), std::runtime_error) << bad;
+  }
+}
+
+TEST(Pathological, ReadBudget) {
+  std::stringstream ss(std::string(100, 'a'));
+  scnr::ReadBudget budget(2, 10);
+  auto stream = scnr::StreamData(&ss).budgeted(&budget);
+  scnr::Byte buf[10];
+  EXPECT_TRUE(stream.read(buf, 0, 4));
+  EXPECT_FALSE(stream.read(buf, 0, 8));
+  EXPECT_TRUE(budget.Exhausted());
+  EXPECT_TRUE(stream.advanced(10).read(buf, 0, 6));
+  EXPECT_FALSE(stream.read(buf, 0, 1));
+}
+
+TEST(Fingerprint, Hash) {
+  const std::string data = "The quick brown fox jumps over the lazy dog";
+  auto bytes = reinterpret_cast<const scnr::Byte*>(data.data());
+  for (size_t size = 1; size < data.size(); ++size) {
+    EXPECT_EQ(scnr::hash_bytes(bytes, size), scnr::hash_bytes(bytes, size));
+    EXPECT_NE(scnr::hash_bytes(bytes, size), scnr::hash_bytes(bytes, size + 1));
+    EXPECT_NE(scnr::hash_bytes(bytes, size), scnr::hash_bytes(bytes + 1, size));
+  }
+
+  // copies share a fingerprint, files that differ only in the middle do not
+  auto fingerprint = [](const std::string& content) {
+    std::stringstream ss(content);
+    return scnr::fingerprint(scnr::StreamData(&ss));
+  };
+  std::string large(3 * scnr::kFingerprintChunk + 100, 'a');
+  const auto original = fingerprint(large);
+  EXPECT_EQ(fingerprint(large), original);
+  large[large.size() / 2] = 'b';
+  EXPECT_NE(fingerprint(large), original);
+  EXPECT_NE(fingerprint(large.substr(0, 1000)), fingerprint(large.substr(0, 1001)));
+}
+
 class TParam : public ::testing::TestWithParam<std::pair<std::string, scnr::FileInfo>> {};
 
 TEST_P(TParam, DetectContent) {
   auto [pathstr, expected] = GetParam();
   auto file = scnr::read_file(std::filesystem::path{pathstr});
-  auto fileinfo = scnr::detect_content(file);
+  // what a file is detected as, the details are checked per format
+  auto fileinfo = scnr::summary_key(scnr::detect_content(file));
   EXPECT_EQ(fileinfo, expected);
 }
 
@@ -58,10 +856,17 @@ INSTANTIATE_TEST_SUITE_P(
     std::make_pair("utf8-bom.txt", scnr::TxtFile{.encoding = "UTF-8", .withbom = true}),
     std::make_pair("utf32-le.txt", scnr::TxtFile{.encoding = "UTF-32-LE"}),
     std::make_pair("utf32-be-bom.txt", scnr::TxtFile{.encoding = "UTF-32-BE", .withbom = true}),
+    std::make_pair("utf16-le.txt", scnr::TxtFile{.encoding = "UTF-16-LE"}),
+    std::make_pair("utf16-be.txt", scnr::TxtFile{.encoding = "UTF-16-BE"}),
+    std::make_pair("iso-8859-1.txt", scnr::TxtFile{.encoding = "iso-8859-1"}),
+    std::make_pair("win1252.txt", scnr::TxtFile{.encoding = "extended ascii"}),
     std::make_pair("xml-iso-8859-1.xml", scnr::XmlFile{.encoding = "iso-8859-1"}),
     std::make_pair("xml-ascii.xml", scnr::XmlFile{.encoding = "ASCII"}),
 
-    std::make_pair("amd64.exe", scnr::PEFile{.endian = std::endian::little, .w64 = true, .cputype = "AMD64"}),
+    std::make_pair("amd64.exe", scnr::PEFile{.endian = std::endian::little,
+                                             .w64 = true,
+                                             .cputype = "AMD64",
+                                             .subsystem = "WINDOWS_CUI"}),
     std::make_pair("elf-64-x86.elf", scnr::ElfFile{.endian = std::endian::little,
                                                    .w64 = true,
                                                    .cputype = "X86_64",
@@ -69,11 +874,15 @@ INSTANTIATE_TEST_SUITE_P(
     std::make_pair("mach-o-fat.o",
                    scnr::MachOFile{.value = scnr::MachOFat{.files = {scnr::MachOSingle{.endian = std::endian::little,
                                                                                        .w64 = true,
-                                                                                       .cputype = "X86_64"},
+                                                                                       .cputype = "X86_64",
+                                                                                       .cpusubtype = "X86_64_ALL",
+                                                                                       .platform = "MACOS"},
                                                                      scnr::MachOSingle{.endian = std::endian::little,
                                                                                        .w64 = true,
                                                                                        .cputype = "ARM64",
-                                                                                       .issigned = true}}}})),
+                                                                                       .cpusubtype = "ARM64_ALL",
+                                                                                       .issigned = true,
+                                                                                       .platform = "MACOS"}}}})),
   [](const auto& info) {
     auto testname = info.param.first;
     // gtest forbids having 'complex' chars in the testname
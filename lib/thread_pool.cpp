@@ -78,6 +78,10 @@ void ThreadPool::TaskDone(int tasks) {
   }
 }
 
+size_t ThreadPool::Workers() const {
+  return workers_.size();
+}
+
 ThreadPool* ThreadPool::Current() {
   return gPool;
 }
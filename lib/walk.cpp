@@ -0,0 +1,211 @@
+#include <scnr/walk.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <memory>
+#include <numeric>
+#include <system_error>
+#include <utility>
+
+#if defined(_WIN32)
+  #if !defined(NOMINMAX)
+    #define NOMINMAX
+  #endif
+  #if !defined(WIN32_LEAN_AND_MEAN)
+    #define WIN32_LEAN_AND_MEAN
+  #endif
+  #include <windows.h>
+#else
+  #include <dirent.h>
+  #include <sys/stat.h>
+#endif
+
+#if defined(__linux__)
+  #include <fcntl.h>
+  #include <linux/fiemap.h>
+  #include <linux/fs.h>
+  #include <sys/ioctl.h>
+  #include <unistd.h>
+#endif
+
+namespace {
+
+#if !defined(_WIN32)
+scnr::EntryType EntryTypeOf(unsigned char d_type) {
+  switch (d_type) {
+  #if defined(DT_REG)
+    case DT_REG:
+      return scnr::EntryType::kRegular;
+    case DT_DIR:
+      return scnr::EntryType::kDirectory;
+    case DT_LNK:
+      return scnr::EntryType::kSymlink;
+    case DT_UNKNOWN:
+      return scnr::EntryType::kUnknown;
+    default:
+      return scnr::EntryType::kOther;
+  #else
+    default:
+      return scnr::EntryType::kUnknown;
+  #endif
+  }
+}
+#endif
+
+// Physical offset of the first extent of the file, 0 if unknown
+std::uint64_t PhysicalOffset(const std::filesystem::path& path) {
+#if defined(__linux__)
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOATIME);
+  if (fd < 0 && errno == EPERM) {
+    // O_NOATIME is only allowed for the owner
+    fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  }
+  if (fd < 0) {
+    return 0;
+  }
+  // room for the header and a single extent
+  alignas(fiemap) unsigned char buf[sizeof(fiemap) + sizeof(fiemap_extent)] = {};
+  auto request = reinterpret_cast<fiemap*>(buf);
+  request->fm_length = FIEMAP_MAX_OFFSET;
+  request->fm_extent_count = 1;
+  std::uint64_t retval = 0;
+  if (::ioctl(fd, FS_IOC_FIEMAP, request) == 0 && request->fm_mapped_extents > 0) {
+    retval = request->fm_extents[0].fe_physical;
+  }
+  ::close(fd);
+  return retval;
+#else
+  (void)path;
+  return 0;
+#endif
+}
+
+}  // namespace
+
+namespace scnr {
+
+std::optional<FileStatus> stat_file(const std::filesystem::path& path) {
+#if defined(_WIN32)
+  // the volume serial number and the file index identify the file, they need an open handle; backup semantics
+  // let directories be opened too
+  HANDLE handle = ::CreateFileW(path.c_str(), FILE_READ_ATTRIBUTES,
+                                FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                                FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+  if (handle == INVALID_HANDLE_VALUE) {
+    return {};
+  }
+  BY_HANDLE_FILE_INFORMATION info;
+  const bool ok = ::GetFileInformationByHandle(handle, &info);
+  ::CloseHandle(handle);
+  if (!ok) {
+    return {};
+  }
+  return FileStatus{
+    .id = FileId{.dev = info.dwVolumeSerialNumber,
+                 .ino = std::uint64_t{info.nFileIndexHigh} << 32 | info.nFileIndexLow},
+    .nlink = info.nNumberOfLinks,
+    .size = std::uint64_t{info.nFileSizeHigh} << 32 | info.nFileSizeLow};
+#else
+  struct stat st;
+  if (::stat(path.c_str(), &st) != 0) {
+    return {};
+  }
+  return FileStatus{
+    .id = FileId{.dev = static_cast<std::uint64_t>(st.st_dev), .ino = static_cast<std::uint64_t>(st.st_ino)},
+    .nlink = static_cast<std::uint64_t>(st.st_nlink),
+    .size = static_cast<std::uint64_t>(st.st_size)};
+#endif
+}
+
+EntryType entry_type(const std::filesystem::path& path, bool follow_symlinks) {
+  std::error_code ec;
+  auto status = follow_symlinks ? std::filesystem::status(path, ec) : std::filesystem::symlink_status(path, ec);
+  switch (status.type()) {
+    case std::filesystem::file_type::none:
+    case std::filesystem::file_type::not_found:
+      return EntryType::kUnknown;
+    case std::filesystem::file_type::regular:
+      return EntryType::kRegular;
+    case std::filesystem::file_type::directory:
+      return EntryType::kDirectory;
+    case std::filesystem::file_type::symlink:
+      return EntryType::kSymlink;
+    default:
+      return EntryType::kOther;
+  }
+}
+
+#if defined(_WIN32)
+
+std::vector<DirEntry> list_directory(const std::filesystem::path& path) {
+  // FindNextFile already reports the attributes, directory_entry caches them
+  std::vector<DirEntry> retval;
+  for (const auto& dir_entry : std::filesystem::directory_iterator(path)) {
+    EntryType type = EntryType::kOther;
+    if (dir_entry.is_symlink()) {
+      type = EntryType::kSymlink;
+    } else if (dir_entry.is_directory()) {
+      type = EntryType::kDirectory;
+    } else if (dir_entry.is_regular_file()) {
+      type = EntryType::kRegular;
+    }
+    retval.push_back(DirEntry{.path = dir_entry.path(), .type = type});
+  }
+  return retval;
+}
+
+#else
+
+std::vector<DirEntry> list_directory(const std::filesystem::path& path) {
+  std::unique_ptr<DIR, int (*)(DIR*)> dir(::opendir(path.c_str()), ::closedir);
+  if (!dir) {
+    throw std::filesystem::filesystem_error("Could not open directory", path,
+                                            std::error_code(errno, std::generic_category()));
+  }
+
+  std::vector<DirEntry> retval;
+  while (const dirent* entry = ::readdir(dir.get())) {
+    std::string_view name = entry->d_name;
+    if (name == "." || name == "..") {
+      continue;
+    }
+    retval.push_back(DirEntry{.path = path / name, .ino = entry->d_ino, .type = EntryTypeOf(entry->d_type)});
+  }
+  return retval;
+}
+
+#endif
+
+void order_files(std::vector<DirEntry>& files, FileOrder order) {
+  switch (order) {
+    case FileOrder::kDirectory:
+      return;
+    case FileOrder::kInode:
+      std::sort(files.begin(), files.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.ino < rhs.ino;
+      });
+      return;
+    case FileOrder::kExtent:
+      break;
+  }
+
+  // files without a mapped extent (empty, inline data, unsupported fs) go first, in inode order
+  std::vector<std::pair<std::uint64_t, std::uint64_t>> keys;
+  keys.reserve(files.size());
+  for (const auto& entry : files) {
+    keys.emplace_back(PhysicalOffset(entry.path), entry.ino);
+  }
+  std::vector<size_t> indices(files.size());
+  std::iota(indices.begin(), indices.end(), 0);
+  std::sort(indices.begin(), indices.end(), [&keys](size_t lhs, size_t rhs) {
+    return keys[lhs] < keys[rhs];
+  });
+  std::vector<DirEntry> sorted;
+  sorted.reserve(files.size());
+  for (auto i : indices) {
+    sorted.push_back(std::move(files[i]));
+  }
+  files = std::move(sorted);
+}
+
+}  // namespace scnr
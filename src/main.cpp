@@ -2,14 +2,22 @@
 #include <scnr/scnr.hpp>
 #include <scnr/thread_pool.hpp>
 
+#include <cerrno>
+#include <chrono>
 #include <csignal>
+#include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 
 int stopcalls = 0;
@@ -24,12 +32,44 @@ void handle_stop(int sig) {
 
 struct CmdOptions {
   std::optional<int> jobs;
+  std::optional<std::chrono::milliseconds> scan_timeout;
+  bool list = false;
+  bool embedded = false;
   std::vector<std::string> files;
+  scnr::ScanOptions scan;
 
   static constexpr std::string_view help_message = R"(Usage: scanner [OPTION...] FILE...
 Determine type of FILEs and collect statistics
   -h, --help                  display this help and exit
   -j N, --jobs N              specifies the number of jobs (commands) to run simultaneously
+  --traversal=depth|breadth   directory walk order (default: depth)
+  --order=readdir|inode|extent
+                              order in which files of a directory are read by the depth-first walk;
+                              extent sorts by physical location (FIEMAP) on cold caches (default: inode)
+  --hardlinks=off|count-links|count-inodes
+                              read files with several hard links once and count either every link or
+                              the inode once; also skips directories seen before (default: off)
+  --follow=never|files|all    which symlinks met during the walk are followed, directories are walked
+                              once so symlink loops terminate (default: all)
+  --file-timeout=SECONDS      give up detection of a single file after that time, it is reported as Timeout
+  --scan-timeout=SECONDS      stop the whole scan after that time and print what has been collected
+  --dedup-content             detect files with identical content (size and hash of all bytes) once
+                              and count the result for every copy
+  --archive-depth=N           look into archives (ar, tar, zip) nested up to N levels deep, 0 only
+                              identifies them (default: 1); members are summarized separately
+  --archive-members=N         look at no more than N members of a single archive (default: 10000)
+  --decompress-max=N          detect the content of gzip files from at most N decompressed bytes,
+                              0 only identifies compressed files (default: 1048576)
+  --script-encoding           also detect the text encoding of scripts, not only the interpreter
+  --data-head=N               report files as data without text checks when every 4-byte lane of the
+                              first N bytes (at most 16384) is NUL often enough, 0 disables (default: 4096)
+  --data-nul-percent=N        share of NUL bytes in each lane that makes a head binary, 1 to 100 (default: 10)
+  --magic-rules=FILE          match the rules of FILE before the built-in detectors, one per line: offset,
+                              magic bytes in hex with an optional /mask, name; matches are reported as custom
+  --embedded                  also search every file for payloads at later offsets, e.g. firmware images or
+                              self-extracting installers, and print them with their offset
+  --list                      print every file with its result and per-file details (ELF needed
+                              libraries, soname, build-id) before the summary
 )";
 
   void print_help() {
@@ -37,6 +77,37 @@ Determine type of FILEs and collect statistics
     std::exit(1);
   }
 
+  // Matches '--name=value' and returns the value
+  static std::optional<std::string_view> option_value(std::string_view arg, std::string_view name) {
+    if (arg.size() <= name.size() || arg.substr(0, name.size()) != name || arg[name.size()] != '=') {
+      return {};
+    }
+    return arg.substr(name.size() + 1);
+  }
+
+  // Parses a non-negative integer
+  size_t parse_count(std::string_view value) {
+    std::string str(value);
+    char* end = nullptr;
+    errno = 0;
+    auto count = std::strtoull(str.c_str(), &end, 10);
+    if (str.empty() || str[0] == '-' || *end != '\0' || errno == ERANGE) {
+      print_help();
+    }
+    return count;
+  }
+
+  // Parses a positive number of seconds, fractions allowed
+  std::chrono::milliseconds parse_seconds(std::string_view value) {
+    std::string str(value);
+    char* end = nullptr;
+    double seconds = std::strtod(str.c_str(), &end);
+    if (str.empty() || *end != '\0' || !(seconds > 0)) {
+      print_help();
+    }
+    return std::chrono::milliseconds(static_cast<int64_t>(seconds * 1000));
+  }
+
   void parse(int argc, char** argv) {
     for (int i = 1; i < argc; ++i) {
       auto arg = argv[i];
@@ -56,6 +127,110 @@ Determine type of FILEs and collect statistics
         if (jobs.value() <= 0) {
           print_help();
         }
+        continue;
+      }
+      if (auto value = option_value(arg, "--traversal")) {
+        if (value == "depth") {
+          scan.traversal = scnr::Traversal::kDepthFirst;
+        } else if (value == "breadth") {
+          scan.traversal = scnr::Traversal::kBreadthFirst;
+        } else {
+          print_help();
+        }
+        continue;
+      }
+      if (auto value = option_value(arg, "--order")) {
+        if (value == "readdir") {
+          scan.order = scnr::FileOrder::kDirectory;
+        } else if (value == "inode") {
+          scan.order = scnr::FileOrder::kInode;
+        } else if (value == "extent") {
+          scan.order = scnr::FileOrder::kExtent;
+        } else {
+          print_help();
+        }
+        continue;
+      }
+      if (auto value = option_value(arg, "--follow")) {
+        if (value == "never") {
+          scan.follow = scnr::Follow::kNever;
+        } else if (value == "files") {
+          scan.follow = scnr::Follow::kFiles;
+        } else if (value == "all") {
+          scan.follow = scnr::Follow::kAll;
+        } else {
+          print_help();
+        }
+        continue;
+      }
+      if (auto value = option_value(arg, "--file-timeout")) {
+        scan.file_timeout = parse_seconds(value.value());
+        continue;
+      }
+      if (auto value = option_value(arg, "--scan-timeout")) {
+        scan_timeout = parse_seconds(value.value());
+        continue;
+      }
+      if (auto value = option_value(arg, "--archive-depth")) {
+        scan.containers.max_depth = parse_count(value.value());
+        continue;
+      }
+      if (auto value = option_value(arg, "--archive-members")) {
+        scan.containers.max_members = parse_count(value.value());
+        continue;
+      }
+      if (auto value = option_value(arg, "--decompress-max")) {
+        scan.containers.max_decompressed = parse_count(value.value());
+        continue;
+      }
+      if (auto value = option_value(arg, "--data-head")) {
+        scan.containers.data.head = parse_count(value.value());
+        continue;
+      }
+      if (auto value = option_value(arg, "--data-nul-percent")) {
+        const size_t percent = parse_count(value.value());
+        if (percent < 1 || percent > 100) {
+          print_help();
+        }
+        scan.containers.data.nul_percent = static_cast<unsigned>(percent);
+        continue;
+      }
+      if (auto value = option_value(arg, "--magic-rules")) {
+        try {
+          scan.containers.rules = std::make_shared<scnr::MagicRules>(scnr::MagicRules::Load(value.value()));
+        } catch (const std::runtime_error& ex) {
+          std::cerr << ex.what() << "\n";
+          std::exit(1);
+        }
+        continue;
+      }
+      if (std::strcmp(arg, "--script-encoding") == 0) {
+        scan.containers.script_encoding = true;
+        continue;
+      }
+      if (std::strcmp(arg, "--embedded") == 0) {
+        embedded = true;
+        continue;
+      }
+      if (std::strcmp(arg, "--list") == 0) {
+        list = true;
+        continue;
+      }
+      if (std::strcmp(arg, "--dedup-content") == 0) {
+        scan.dedup_content = true;
+        continue;
+      }
+      if (auto value = option_value(arg, "--hardlinks")) {
+        if (value == "off") {
+          scan.hardlinks = scnr::HardLinks::kOff;
+        } else if (value == "count-links") {
+          scan.hardlinks = scnr::HardLinks::kCountLinks;
+        } else if (value == "count-inodes") {
+          scan.hardlinks = scnr::HardLinks::kCountInodes;
+        } else {
+          print_help();
+        }
+        continue;
       }
       files.push_back(arg);
     }
@@ -76,26 +251,74 @@ int main(int argc, char** argv) {
   int jobs = options.jobs.value_or(hw_concurrency);
   jobs = std::min(hw_concurrency, jobs);
 
+  options.scan.ctx = &scnr::gContext;
+  if (options.scan_timeout) {
+    scnr::gContext.SetDeadline(scnr::Clock::now() + options.scan_timeout.value());
+  }
+
+  std::mutex list_mutex;
+  if (options.list) {
+    options.scan.on_file = [&list_mutex](const std::filesystem::path& path, const scnr::FileInfo& fileinfo) {
+      std::stringstream ss;
+      ss << path.string() << ": " << scnr::Detailed{fileinfo} << "\n";
+      std::lock_guard lock(list_mutex);
+      std::cout << ss.str();
+    };
+  }
+
+  if (options.embedded) {
+    options.scan.on_embedded = [&list_mutex](const std::filesystem::path& path,
+                                             const std::vector<scnr::EmbeddedFile>& embedded) {
+      std::stringstream ss;
+      for (const auto& payload : embedded) {
+        ss << path.string() << "@0x" << std::hex << payload.offset << std::dec << ": " << scnr::Detailed{payload.info}
+           << "\n";
+      }
+      std::lock_guard lock(list_mutex);
+      std::cout << ss.str();
+    };
+  }
+
   scnr::ThreadPool pool(jobs, &scnr::gContext);
   scnr::FileInfoCollector collector;
 
   for (const auto& f : options.files) {
-    pool.Submit([f, &collector]() {
-      scnr::process(std::filesystem::path(f), collector);
+    pool.Submit([f, &collector, &options]() {
+      scnr::process(std::filesystem::path(f), collector, options.scan);
     });
   }
 
   pool.WaitIdle();
   pool.Stop();
 
-  if (scnr::gContext.StopRequested()) {
+  // read once, the deadline may pass or a signal come while the results are printed
+  const bool timed_out = scnr::gContext.DeadlineHit();
+  const bool stopped = scnr::gContext.Stopped();
+  if (timed_out) {
+    std::cout << "\nScan timeout.\n";
+  } else if (stopped) {
     std::cout << "\nInterrupted.\n";
   }
   for (const auto& [k, v] : collector.Summarize()) {
     std::cout << k << " - " << v << "\n";
   }
+  if (auto members = collector.SummarizeMembers(); !members.empty()) {
+    std::cout << "\nArchive members:\n";
+    for (const auto& [k, v] : members) {
+      std::cout << k << " - " << v.container << ": " << v.info << "\n";
+    }
+  }
+  auto stats = collector.Stats();
+  if (stats.hardlinks || stats.directories) {
+    std::cout << "\nSkipped: " << stats.hardlinks << " hard links to files already read, " << stats.directories
+              << " directories already walked\n";
+  }
+  if (stats.duplicates) {
+    std::cout << "\nDuplicates: " << stats.duplicates << " files with known content, " << stats.duplicate_bytes
+              << " bytes not scanned\n";
+  }
 
-  if (scnr::gContext.StopRequested()) {
+  if (stopped) {
     return 1;
   }
   return 0;